@@ -0,0 +1,31 @@
+# Writes the embedded shader table for one target, for findEmbeddedShader()
+# (see common/embedded_shaders.h). Run at build time with
+#   cmake -DOUTPUT=<file.cpp> -DBASE=<dir> -DSHADERS=<a|b|...> -P embed_shaders.cmake
+# Each shader is keyed by its path relative to BASE, i.e. the path the demo passes to
+# LoadShader() when the file sits next to the executable.
+
+string(REPLACE "|" ";" SHADERS "${SHADERS}")
+
+set(content "/* Generated by cmake/embed_shaders.cmake, do not edit */\n\n")
+string(APPEND content "#include \"embedded_shaders.h\"\n\n")
+
+set(index 0)
+set(entries "")
+foreach (shader ${SHADERS})
+    file(READ ${shader} text)
+    string(REPLACE "\r\n" "\n" text "${text}")
+    file(RELATIVE_PATH key ${BASE} ${shader})
+
+    string(APPEND content "static constexpr char shader${index}[] = R\"glsl(${text})glsl\";\n")
+    string(APPEND entries "    {\"${key}\", embeddedShaderHash(\"${key}\"), shader${index}, sizeof(shader${index}) - 1, "
+            "embeddedShaderHash(shader${index})},\n")
+    math(EXPR index "${index} + 1")
+endforeach ()
+
+string(APPEND content "\n// Constant initialised, the name and source hashes are computed by the compiler\n")
+string(APPEND content "extern const EmbeddedShader embeddedShaders[] = {\n${entries}};\n\n")
+string(APPEND content "extern const int embeddedShaderCount = ${index};\n")
+
+# configure_file() leaves the output untouched when nothing changed, so the target does not relink
+file(WRITE ${OUTPUT}.tmp "${content}")
+configure_file(${OUTPUT}.tmp ${OUTPUT} COPYONLY)
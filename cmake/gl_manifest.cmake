@@ -0,0 +1,28 @@
+# Writes the GL manifest for one target: every gl* function name its sources mention,
+# for gladLoadGLManifest() (see common/glad_manifest.h). Run at build time with
+#   cmake -DOUTPUT=<file.c> -DSOURCES=<a|b|...> -P gl_manifest.cmake
+# Names that are not GL functions (comments, glad's own symbols) are harmless, the
+# loader skips anything glad does not know.
+
+string(REPLACE "|" ";" SOURCES "${SOURCES}")
+
+set(names "")
+foreach (source ${SOURCES})
+    file(READ ${source} text)
+    string(REGEX MATCHALL "gl[A-Z][A-Za-z0-9_]*" found "${text}")
+    list(APPEND names ${found})
+endforeach ()
+list(REMOVE_DUPLICATES names)
+list(SORT names)
+list(LENGTH names count)
+
+set(content "/* Generated by cmake/gl_manifest.cmake, do not edit */\n\n")
+string(APPEND content "const char *const gladManifestNames[] = {\n")
+foreach (name ${names})
+    string(APPEND content "    \"${name}\",\n")
+endforeach ()
+string(APPEND content "    0\n};\n\nconst int gladManifestCount = ${count};\n")
+
+# configure_file() leaves the output untouched when nothing changed, so the target does not relink
+file(WRITE ${OUTPUT}.tmp "${content}")
+configure_file(${OUTPUT}.tmp ${OUTPUT} COPYONLY)
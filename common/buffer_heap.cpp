@@ -0,0 +1,169 @@
+/**
+  buffer_heap.cpp
+  Pages are GL_STATIC_DRAW buffers, written with glBufferSubData through GL_COPY_WRITE_BUFFER
+  so no vertex array or element binding is disturbed
+  */
+
+#include "buffer_heap.h"
+
+#include <algorithm>
+
+using namespace std;
+
+BufferHeap::BufferHeap(GLsizeiptr pageSize, GLsizeiptr unit) {
+    this->unit = unit > 0 ? unit : 16;
+    this->pageSize = (pageSize + this->unit - 1) / this->unit * this->unit;
+    this->blocksMoved = 0;
+    this->bytesMoved = 0;
+    this->stuck = false;
+}
+
+BufferHeap::~BufferHeap() {
+    for (Page &page : pages) glDeleteBuffers(1, &page.buffer);
+}
+
+void BufferHeap::addPage(GLsizeiptr size) {
+    Page page = {0, size, OffsetAllocator(units(size))};
+    glGenBuffers(1, &page.buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, page.buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    pages.push_back(page);
+}
+
+BufferHeap::Handle BufferHeap::allocate(GLsizeiptr size) {
+    if (size <= 0) return INVALID;
+
+    Block block;
+    block.allocation.offset = OffsetAllocator::NO_SPACE;
+    for (block.page = 0; block.page < pages.size(); block.page++) {
+        block.allocation = pages[block.page].allocator.allocate(units(size));
+        if (block.allocation.offset != OffsetAllocator::NO_SPACE) break;
+    }
+    if (block.allocation.offset == OffsetAllocator::NO_SPACE) {
+        addPage(max(pageSize, (GLsizeiptr) units(size) * unit));
+        block.page = (uint32_t) pages.size() - 1;
+        block.allocation = pages.back().allocator.allocate(units(size));
+    }
+    block.offset = (GLintptr) block.allocation.offset * unit;
+    block.size = size;
+    block.live = true;
+    stuck = false;
+
+    if (!spareHandles.empty()) {
+        Handle handle = spareHandles.back();
+        spareHandles.pop_back();
+        blocks[handle] = block;
+        return handle;
+    }
+    blocks.push_back(block);
+    return (Handle) blocks.size() - 1;
+}
+
+BufferHeap::Handle BufferHeap::upload(const void *data, GLsizeiptr size) {
+    Handle handle = allocate(size);
+    if (handle != INVALID) update(handle, data, size);
+    return handle;
+}
+
+void BufferHeap::update(Handle handle, const void *data, GLsizeiptr size, GLintptr at) {
+    const Block &block = blocks[handle];
+    if (at < 0 || at + size > block.size) return;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, pages[block.page].buffer);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, block.offset + at, size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void BufferHeap::free(Handle handle) {
+    if (handle >= blocks.size() || !blocks[handle].live) return;
+    Block &block = blocks[handle];
+    pages[block.page].allocator.free(block.allocation);
+    block.live = false;
+    spareHandles.push_back(handle);
+    stuck = false;
+}
+
+bool BufferHeap::isPacked() const {
+    if (pages.empty()) return true;
+    for (const Page &page : pages) {
+        if (!page.allocator.isPacked()) return false;
+    }
+    // Several packed pages can still shrink if the last one fits into the others
+    size_t earlierFree = 0;
+    for (size_t i = 0; i + 1 < pages.size(); i++) earlierFree += pages[i].allocator.getFree();
+    const OffsetAllocator &last = pages.back().allocator;
+    return last.getCapacity() - last.getFree() > earlierFree;
+}
+
+GLsizeiptr BufferHeap::compact(GLsizeiptr maxBytes, vector<Handle> *moved) {
+    // A hole no block fits in keeps isPacked() false, without the flag every call would sort again for nothing
+    if (stuck || isPacked()) return 0;
+
+    // Highest blocks first: moving those opens up the end of each page and empties the last pages
+    vector<Handle> order;
+    for (Handle handle = 0; handle < blocks.size(); handle++) {
+        if (blocks[handle].live) order.push_back(handle);
+    }
+    sort(order.begin(), order.end(), [this](Handle a, Handle b) {
+        if (blocks[a].page != blocks[b].page) return blocks[a].page > blocks[b].page;
+        return blocks[a].offset > blocks[b].offset;
+    });
+
+    GLsizeiptr bytes = 0;
+    for (Handle handle : order) {
+        if (bytes >= maxBytes) break;
+        Block &block = blocks[handle];
+
+        // Only ever move to an earlier page or a lower offset, so blocks cannot move back and forth
+        for (uint32_t page = 0; page <= block.page; page++) {
+            OffsetAllocator::Allocation target = pages[page].allocator.allocate(units(block.size));
+            if (target.offset == OffsetAllocator::NO_SPACE) continue;
+            if (page == block.page && target.offset > block.allocation.offset) {
+                pages[page].allocator.free(target);
+                break;
+            }
+
+            GLintptr targetOffset = (GLintptr) target.offset * unit;
+            glBindBuffer(GL_COPY_READ_BUFFER, pages[block.page].buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, pages[page].buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, block.offset, targetOffset, block.size);
+
+            pages[block.page].allocator.free(block.allocation);
+            block.page = page;
+            block.allocation = target;
+            block.offset = targetOffset;
+            if (moved) moved->push_back(handle);
+            bytes += block.size;
+            blocksMoved++;
+            bytesMoved += block.size;
+            break;
+        }
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // Pages are referred to by index, so only trailing empty pages can go
+    while (pages.size() > 1 && pages.back().allocator.getFree() == pages.back().allocator.getCapacity()) {
+        glDeleteBuffers(1, &pages.back().buffer);
+        pages.pop_back();
+    }
+    stuck = bytes == 0;
+    return bytes;
+}
+
+BufferHeap::Stats BufferHeap::getStats() const {
+    Stats stats = {};
+    stats.pages = pages.size();
+    stats.blocks = blocks.size() - spareHandles.size();
+    for (const Page &page : pages) {
+        const OffsetAllocator &allocator = page.allocator;
+        stats.bytesUsed += (size_t) (allocator.getCapacity() - allocator.getFree()) * unit;
+        stats.bytesFree += (size_t) allocator.getFree() * unit;
+        stats.largestFree = max(stats.largestFree, (size_t) allocator.getLargestFree() * unit);
+        stats.freeRegions += allocator.getFreeRegions();
+    }
+    stats.fragmentation = stats.bytesFree > 0 ? 1.0 - double(stats.largestFree) / stats.bytesFree : 0;
+    stats.blocksMoved = blocksMoved;
+    stats.bytesMoved = bytesMoved;
+    return stats;
+}
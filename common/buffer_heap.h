@@ -0,0 +1,116 @@
+/**
+buffer_heap.h
+Vertex and index data of many meshes carved out of a few large buffers ("pages") instead
+of one buffer object per mesh, so meshes can share a vertex array binding and be drawn
+with a first vertex / base vertex instead of a rebind. Each page is managed by an
+OffsetAllocator. Blocks are referred to by handle because compact() moves them: look up
+buffer() and offset() when drawing, and set up again the vertex arrays of the handles
+compact() reports as moved.
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "offset_allocator.h"
+
+class BufferHeap {
+public:
+    typedef uint32_t Handle;
+    static const Handle INVALID = 0xffffffff;
+
+    struct Stats {
+        size_t pages;
+        size_t blocks;
+        size_t bytesUsed;       // Rounded up to the allocation unit
+        size_t bytesFree;
+        size_t largestFree;     // Largest free region in any page
+        size_t freeRegions;
+        double fragmentation;   // 1 - largestFree / bytesFree: 0 when free space is one region
+        size_t blocksMoved;     // By compact(), so far
+        size_t bytesMoved;
+    };
+
+    /* Pages of pageSize bytes are created on demand; a block larger than that gets a page of its own.
+       Offsets are multiples of `unit`, which vertex strides passed to firstVertex() should divide. */
+    explicit BufferHeap(GLsizeiptr pageSize = 16 << 20, GLsizeiptr unit = 16);
+
+    /* Deletes the pages, the context must be current */
+    ~BufferHeap();
+
+    /* Reserve `size` bytes, adding a page if none has room. INVALID if size is not positive. */
+    Handle allocate(GLsizeiptr size);
+
+    /* allocate() and fill with `data` */
+    Handle upload(const void *data, GLsizeiptr size);
+
+    /* Overwrite part of a block */
+    void update(Handle handle, const void *data, GLsizeiptr size, GLintptr at = 0);
+
+    void free(Handle handle);
+
+    /* Buffer holding the block, to bind as GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER */
+    GLuint buffer(Handle handle) const {
+        return pages[blocks[handle].page].buffer;
+    }
+
+    /* Byte offset of the block in buffer() */
+    GLintptr offset(Handle handle) const {
+        return blocks[handle].offset;
+    }
+
+    GLsizeiptr size(Handle handle) const {
+        return blocks[handle].size;
+    }
+
+    /* Index of the block's first element with the attribute pointer at the start of the page,
+       the `first` of glDrawArrays or the basevertex of glDrawElementsBaseVertex */
+    GLint firstVertex(Handle handle, GLsizei stride) const {
+        return (GLint) (blocks[handle].offset / stride);
+    }
+
+    /* Move up to maxBytes of blocks towards the start of the heap, to merge free regions and empty
+       the last pages, which are then deleted. Copies run on the GPU (glCopyBufferSubData), so calling
+       it once per frame with a small budget compacts in the background. Returns the bytes moved;
+       after a call that moved nothing it returns at once until a block is allocated or freed.
+       Moved blocks are appended to `moved`: their buffer() and offset() have changed, so vertex
+       arrays that were set up with them point at stale data until they are set up again. */
+    GLsizeiptr compact(GLsizeiptr maxBytes, std::vector<Handle> *moved = nullptr);
+
+    Stats getStats() const;
+
+private:
+    struct Page {
+        GLuint buffer;
+        GLsizeiptr size;
+        OffsetAllocator allocator; // In units
+    };
+
+    struct Block {
+        uint32_t page;
+        OffsetAllocator::Allocation allocation;
+        GLintptr offset;
+        GLsizeiptr size;
+        bool live;
+    };
+
+    GLsizeiptr pageSize;
+    GLsizeiptr unit;
+    std::vector<Page> pages;
+    std::vector<Block> blocks;
+    std::vector<Handle> spareHandles;
+    size_t blocksMoved;
+    size_t bytesMoved;
+    bool stuck; // The last compact() moved nothing, and no block was allocated or freed since
+
+    uint32_t units(GLsizeiptr bytes) const {
+        return (uint32_t) ((bytes + unit - 1) / unit);
+    }
+
+    void addPage(GLsizeiptr size);
+
+    bool isPacked() const;
+};
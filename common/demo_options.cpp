@@ -0,0 +1,134 @@
+/**
+  demo_options.cpp
+  Command line parsing shared by the graphics examples
+  */
+
+#include "demo_options.h"
+#include "wrapper_glfw.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+static const int DEFAULT_BENCHMARK_FRAMES = 1000;
+
+DemoOptions parseDemoOptions(int argc, char *argv[]) {
+    DemoOptions options;
+
+    if (argc > 0) {
+        const char *slash = max(strrchr(argv[0], '/'), strrchr(argv[0], '\\'));
+        options.name = slash ? slash + 1 : argv[0];
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(arg, "--headless") == 0) {
+            options.headless = true;
+        } else if (strcmp(arg, "--frames") == 0 && hasValue) {
+            options.frames = atoi(argv[++i]);
+        } else if (strcmp(arg, "--benchmark") == 0) {
+            options.benchmark = true;
+        } else if (strcmp(arg, "--warmup") == 0 && hasValue) {
+            options.warmup = max(0, atoi(argv[++i]));
+            options.benchmark = true;
+        } else if (strcmp(arg, "--size") == 0 && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &options.width, &options.height) != 2
+                    || options.width <= 0 || options.height <= 0) {
+                cerr << "Ignoring bad size " << argv[i] << ", expected WxH" << endl;
+                options.width = options.height = 0;
+            }
+        } else if (strcmp(arg, "--views") == 0 && hasValue) {
+            options.views = max(1, atoi(argv[++i]));
+        } else if (strcmp(arg, "--update-thread") == 0) {
+            options.updateThread = true;
+        } else if (strcmp(arg, "--swap-interval") == 0 && hasValue) {
+            options.swapInterval = atoi(argv[++i]);
+        } else if (strcmp(arg, "--max-frames-in-flight") == 0 && hasValue) {
+            options.maxFramesInFlight = max(0, atoi(argv[++i]));
+        } else if (strcmp(arg, "--hot-reload") == 0) {
+            options.hotReload = true;
+        } else if (strcmp(arg, "--optimize-shaders") == 0) {
+            options.optimizeShaders = true;
+        } else if (strcmp(arg, "--separable") == 0) {
+            options.separable = true;
+        } else if (strcmp(arg, "--program-cache") == 0 && hasValue) {
+            options.programCache = argv[++i];
+        } else if (strcmp(arg, "--stats") == 0) {
+            options.stats = true;
+        } else if (strcmp(arg, "--stats-csv") == 0 && hasValue) {
+            options.statsCSV = argv[++i];
+            options.stats = true;
+        } else if (strcmp(arg, "--stats-json") == 0 && hasValue) {
+            options.statsJSON = argv[++i];
+            options.stats = true;
+        } else {
+            cerr << "Ignoring unknown option " << arg << endl;
+        }
+    }
+
+    // A benchmark has to end by itself
+    if (options.benchmark && options.frames <= 0) options.frames = DEFAULT_BENCHMARK_FRAMES;
+
+    return options;
+}
+
+void applyDemoOptions(GLWrapper *glw, const DemoOptions &options) {
+    glw->setFrameLimit(options.frames);
+    glw->setUpdateThread(options.updateThread);
+    glw->setSwapInterval(options.benchmark ? 0 : options.swapInterval);
+    glw->setMaxFramesInFlight(options.maxFramesInFlight);
+    if (options.programCache) glw->enableProgramCache(options.programCache);
+    glw->setShaderOptimization(options.optimizeShaders);
+
+    if (options.benchmark) {
+        glw->setDeterministic(true);
+        glw->setWarmupFrames(options.warmup);
+    }
+
+    // Keep every measured frame of a benchmark, not just the most recent ones
+    if (options.stats || options.benchmark) {
+        glw->enableFrameStats(max<size_t>(4096, options.benchmark ? options.frames : 0));
+        glw->setFrameStatsFiles(options.statsCSV, options.statsJSON);
+    }
+}
+
+/* {"p50": ..., "p90": ..., ...} for one column of the frame stats */
+static void writeSummary(ostream &out, const FrameStats::Summary &s) {
+    out << "{\"p50\": " << s.p50 << ", \"p90\": " << s.p90 << ", \"p99\": " << s.p99
+            << ", \"max\": " << s.max << ", \"mean\": " << s.mean << "}";
+}
+
+void reportBenchmark(GLWrapper *glw, const DemoOptions &options) {
+    FrameStats *stats = glw->getFrameStats();
+    if (!options.benchmark || !stats) return;
+
+    // Frames are back to back, so their times add up to the wall time of the measured run
+    FrameStats::Summary frame = stats->summarise(&FrameStats::Sample::frame);
+    double seconds = frame.mean * frame.samples / 1000.0;
+
+    int width, height;
+    glw->getFramebufferSize(width, height);
+
+    cout << "{\"benchmark\": \"" << options.name << "\", \"width\": " << width << ", \"height\": " << height
+            << ", \"warmup\": " << options.warmup << ", \"frames\": " << stats->size()
+            << ", \"seconds\": " << seconds << ", \"fps\": " << (seconds > 0 ? stats->size() / seconds : 0)
+            << ", \"frame_ms\": ";
+    writeSummary(cout, frame);
+    cout << ", \"render_ms\": ";
+    writeSummary(cout, stats->summarise(&FrameStats::Sample::render));
+    cout << ", \"swap_ms\": ";
+    writeSummary(cout, stats->summarise(&FrameStats::Sample::swap));
+
+    // Calls made through GLWrapper::getState() and how many of them it dropped, per frame
+    const GLState &state = glw->getState();
+    size_t stateFrames = state.getFrames() > 0 ? state.getFrames() : 1;
+    cout << ", \"state_calls_per_frame\": " << double(state.getTotal().calls) / stateFrames
+            << ", \"state_elided_per_frame\": " << double(state.getTotal().elided) / stateFrames;
+    cout << "}" << endl;
+}
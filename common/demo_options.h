@@ -0,0 +1,39 @@
+/**
+demo_options.h
+Command line options shared by the graphics examples
+*/
+#pragma once
+
+class GLWrapper;
+
+struct DemoOptions {
+    const char *name = "";          // Executable name without the directory, for reports
+    bool headless = false;          // --headless
+    int frames = 0;                 // --frames N, 0 runs until the window is closed
+    bool benchmark = false;         // --benchmark, or implied by --warmup: see applyDemoOptions()
+    int warmup = 0;                 // --warmup M, frames run before measuring starts
+    int width = 0;                  // --size WxH, 0 keeps the demo's own window size
+    int height = 0;
+    int views = 1;                  // --views N, windows sharing one context group (vertex_attribs)
+    bool updateThread = false;      // --update-thread, run the update callback on its own thread
+    int swapInterval = 1;           // --swap-interval N, -1 for adaptive vsync
+    int maxFramesInFlight = 0;      // --max-frames-in-flight N, 0 leaves queueing to the driver
+    bool hotReload = false;         // --hot-reload, rebuild shaders when their files change
+    bool optimizeShaders = false;   // --optimize-shaders, see ShaderOptimizer
+    bool separable = false;         // --separable, draw with program pipelines (vertex_attribs)
+    const char *programCache = nullptr; // --program-cache DIR, off by default
+    bool stats = false;             // --stats, or implied by either file below
+    const char *statsCSV = nullptr; // --stats-csv FILE
+    const char *statsJSON = nullptr;// --stats-json FILE
+};
+
+DemoOptions parseDemoOptions(int argc, char *argv[]);
+
+/* Apply everything except headless and size, which have to be passed to the GLWrapper constructor.
+   Benchmark mode makes the wrapper deterministic (see GLWrapper::setDeterministic()), turns off vsync
+   and enables frame stats, the demo schedules its scripted input afterwards. */
+void applyDemoOptions(GLWrapper *glw, const DemoOptions &options);
+
+/* In benchmark mode print one line of JSON with the throughput and frame time distribution
+   of the measured frames, call after the event loop has finished */
+void reportBenchmark(GLWrapper *glw, const DemoOptions &options);
@@ -0,0 +1,129 @@
+/**
+  dynamic_buffer.cpp
+  The five update paths behind one update() call
+  */
+
+#include "dynamic_buffer.h"
+
+#include <cstring>
+
+using namespace std;
+
+/* Largest PERSISTENT segment: with bigger payloads fewer updates share a segment, and the
+   extra ones fence early and move to the next */
+static const GLsizeiptr MAX_SEGMENT = 64 << 20;
+
+static const char *const STRATEGY_NAMES[DynamicBuffer::STRATEGY_COUNT] = {
+        "buffer_data", "orphan", "sub_data", "map_invalidate", "persistent"
+};
+
+const char *DynamicBuffer::strategyName(Strategy strategy) {
+    return strategy >= 0 && strategy < STRATEGY_COUNT ? STRATEGY_NAMES[strategy] : "unknown";
+}
+
+bool DynamicBuffer::parseStrategy(const char *name, Strategy &strategy) {
+    for (int i = 0; i < STRATEGY_COUNT; i++) {
+        if (strcmp(name, STRATEGY_NAMES[i]) == 0) {
+            strategy = (Strategy) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DynamicBuffer::isSupported(Strategy strategy) {
+    if (strategy == PERSISTENT) return GLAD_GL_VERSION_4_4 && glBufferStorage;
+    return strategy >= 0 && strategy < STRATEGY_COUNT;
+}
+
+DynamicBuffer::DynamicBuffer(GLenum target, GLsizeiptr capacity, Strategy strategy, int updatesPerFrame) {
+    this->target = target;
+    this->capacity = capacity;
+    this->strategy = isSupported(strategy) ? strategy : ORPHAN;
+    this->buffer = 0;
+    this->stream = nullptr;
+    this->streamed = false;
+    this->updates = 0;
+    this->bytesUpdated = 0;
+
+    if (this->strategy == PERSISTENT) {
+        // One aligned slot per update, as many as expected in a frame while that fits MAX_SEGMENT
+        const GLsizeiptr alignment = StreamBuffer::ALIGNMENT;
+        GLsizeiptr slot = (capacity + alignment - 1) / alignment * alignment;
+        GLsizeiptr perSegment = updatesPerFrame > 1 ? updatesPerFrame : 1;
+        if (perSegment * slot > MAX_SEGMENT) perSegment = slot < MAX_SEGMENT ? MAX_SEGMENT / slot : 1;
+        stream = new StreamBuffer(perSegment * slot);
+        if (stream->isPersistent()) return;
+        // The driver refused the persistent mapping, use the nearest mapped strategy
+        delete stream;
+        stream = nullptr;
+        this->strategy = MAP_INVALIDATE;
+    }
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    glBufferData(target, capacity, NULL, this->strategy == BUFFER_DATA ? GL_DYNAMIC_DRAW : GL_STREAM_DRAW);
+}
+
+DynamicBuffer::~DynamicBuffer() {
+    delete stream;
+    if (buffer) glDeleteBuffers(1, &buffer);
+}
+
+void DynamicBuffer::endFrame() {
+    if (!stream || !streamed) return;
+    stream->endFrame();
+    streamed = false;
+}
+
+GLuint DynamicBuffer::getBuffer() const {
+    return stream ? stream->getBuffer() : buffer;
+}
+
+GLintptr DynamicBuffer::update(const void *data, GLsizeiptr size) {
+    if (size > capacity) return -1;
+    updates++;
+    bytesUpdated += size;
+
+    GLintptr offset = 0;
+    if (stream) {
+        // Updates of one frame share a segment, fenced once by endFrame()
+        if (!streamed) stream->beginFrame();
+        streamed = true;
+        offset = stream->write(data, size);
+        if (offset < 0) {
+            // More updates than the segment was sized for, or endFrame() is never called
+            stream->endFrame();
+            stream->beginFrame();
+            offset = stream->write(data, size);
+        }
+        glBindBuffer(target, stream->getBuffer());
+        return offset;
+    }
+
+    glBindBuffer(target, buffer);
+    switch (strategy) {
+        case BUFFER_DATA:
+            glBufferData(target, size, data, GL_DYNAMIC_DRAW);
+            break;
+        case ORPHAN:
+            // Same size and usage as before, so the driver can hand back a free store at once
+            glBufferData(target, capacity, NULL, GL_STREAM_DRAW);
+            glBufferSubData(target, 0, size, data);
+            break;
+        case SUB_DATA:
+            glBufferSubData(target, 0, size, data);
+            break;
+        case MAP_INVALIDATE: {
+            void *pointer = glMapBufferRange(target, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (pointer) {
+                memcpy(pointer, data, size);
+                glUnmapBuffer(target);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    return offset;
+}
@@ -0,0 +1,80 @@
+/**
+dynamic_buffer.h
+A buffer whose contents are replaced from the CPU over and over, with the update
+strategy chosen at creation. Which strategy is fastest depends on the driver and the
+payload size, so pick one from buffer_bench measurements on the target platform:
+  BUFFER_DATA     glBufferData with the data every update (re-specify the store)
+  ORPHAN          glBufferData(NULL) to detach the old store, then glBufferSubData
+  SUB_DATA        glBufferSubData into the same store, which may wait for the GPU
+  MAP_INVALIDATE  glMapBufferRange with GL_MAP_INVALIDATE_BUFFER_BIT, copy, unmap
+  PERSISTENT      a persistently mapped StreamBuffer, one segment per frame (GL 4.4)
+*/
+#pragma once
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+#include "stream_buffer.h"
+
+class DynamicBuffer {
+public:
+    enum Strategy {
+        BUFFER_DATA,
+        ORPHAN,
+        SUB_DATA,
+        MAP_INVALIDATE,
+        PERSISTENT,
+        STRATEGY_COUNT
+    };
+
+    static const char *strategyName(Strategy strategy);
+
+    /* Strategy called `name` (as strategyName() spells it), false if there is none */
+    static bool parseStrategy(const char *name, Strategy &strategy);
+
+    /* PERSISTENT needs glBufferStorage, the others work on any GL 4.1 context */
+    static bool isSupported(Strategy strategy);
+
+    /* Up to `capacity` bytes per update, bound to `target` (e.g. GL_ARRAY_BUFFER) by update().
+       PERSISTENT sizes its segments for updatesPerFrame updates between endFrame() calls.
+       The context must be current. An unsupported strategy falls back to ORPHAN. */
+    DynamicBuffer(GLenum target, GLsizeiptr capacity, Strategy strategy, int updatesPerFrame = 1);
+
+    /* Deletes the buffer, the context must be current */
+    ~DynamicBuffer();
+
+    /* Replace the contents with `size` bytes of `data` and leave the buffer bound to the target.
+       Returns the byte offset the data starts at, which only PERSISTENT moves between updates,
+       or -1 if size exceeds the capacity. Draws issued earlier keep the data they were issued with. */
+    GLintptr update(const void *data, GLsizeiptr size);
+
+    /* Call after the last draw of a frame that reads this buffer. PERSISTENT fences the frame's
+       segment here, so it only waits for the GPU once per frame; the other strategies ignore it. */
+    void endFrame();
+
+    GLuint getBuffer() const;
+
+    Strategy getStrategy() const {
+        return strategy;
+    }
+
+    /* update() calls and bytes sent so far */
+    size_t getUpdates() const {
+        return updates;
+    }
+
+    size_t getBytesUpdated() const {
+        return bytesUpdated;
+    }
+
+private:
+    GLenum target;
+    GLsizeiptr capacity;
+    Strategy strategy;
+    GLuint buffer;          // Every strategy but PERSISTENT
+    StreamBuffer *stream;   // PERSISTENT only
+    bool streamed;          // The stream's current segment has updates and is not fenced yet
+    size_t updates;
+    size_t bytesUpdated;
+};
@@ -0,0 +1,30 @@
+/**
+  embedded_shaders.cpp
+  Lookup into the per-target table generated by cmake/embed_shaders.cmake
+  */
+
+#include "embedded_shaders.h"
+
+#include <cstring>
+
+#ifdef GLWRAPPER_EMBED_SHADERS
+extern const EmbeddedShader embeddedShaders[];
+extern const int embeddedShaderCount;
+#endif
+
+const EmbeddedShader *findEmbeddedShader(const char *path) {
+#ifdef GLWRAPPER_EMBED_SHADERS
+    // "./basic.vert" names the same file as "basic.vert"
+    while (path[0] == '.' && (path[1] == '/' || path[1] == '\\')) path += 2;
+
+    uint64_t hash = embeddedShaderHash(path);
+    for (int i = 0; i < embeddedShaderCount; i++) {
+        if (embeddedShaders[i].pathHash == hash && strcmp(embeddedShaders[i].path, path) == 0) {
+            return &embeddedShaders[i];
+        }
+    }
+#else
+    (void) path;
+#endif
+    return nullptr;
+}
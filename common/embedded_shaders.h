@@ -0,0 +1,31 @@
+/**
+embedded_shaders.h
+Shader sources compiled into the executable by add_embedded_shaders() in CMakeLists.txt,
+so GLWrapper can load them without touching the filesystem
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct EmbeddedShader {
+    const char *path;   // Relative path the shader is loaded by, e.g. "basic.vert"
+    uint64_t pathHash;  // embeddedShaderHash(path), computed at compile time
+    const char *source;
+    size_t length;
+    uint64_t sourceHash; // embeddedShaderHash(source), the program cache key is built from it
+};
+
+/* 64-bit FNV-1a, usable in constant expressions */
+constexpr uint64_t embeddedShaderHash(const char *text) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    while (*text) {
+        hash ^= (unsigned char) *text++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* The embedded copy of `path`, or nullptr when the target embeds no such shader
+   (or was built without GLWRAPPER_EMBED_SHADERS) */
+const EmbeddedShader *findEmbeddedShader(const char *path);
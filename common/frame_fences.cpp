@@ -0,0 +1,81 @@
+/**
+  frame_fences.cpp
+  Fence based frame latency limiter
+  */
+
+#include "frame_fences.h"
+
+using namespace std;
+
+/* Longest we block on a single frame before giving up on it, in nanoseconds */
+static const GLuint64 FENCE_TIMEOUT = 1000000000;
+
+FrameFences::FrameFences() {
+    this->head = 0;
+    this->count = 0;
+    this->limit = 0;
+    this->latency = -1;
+}
+
+void FrameFences::setMaxFramesInFlight(int frames) {
+    if (frames < 0) frames = 0;
+    if (frames > MAX_FRAMES) frames = MAX_FRAMES;
+    this->limit = frames;
+}
+
+void FrameFences::throttle() {
+    while (limit > 0 && count >= limit) {
+        retireOldest(FENCE_TIMEOUT);
+    }
+}
+
+void FrameFences::submit(Clock::time_point inputTime) {
+    // Measuring only: never wait, drop the oldest measurement if the ring is full
+    if (count == MAX_FRAMES) {
+        int oldest = (head + MAX_FRAMES - count) % MAX_FRAMES;
+        glDeleteSync(fences[oldest]);
+        count--;
+    }
+
+    fences[head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    inputTimes[head] = inputTime;
+    head = (head + 1) % MAX_FRAMES;
+    count++;
+}
+
+void FrameFences::collect() {
+    while (count > 0 && retireOldest(0)) {
+    }
+}
+
+double FrameFences::takeLatency() {
+    double value = latency;
+    latency = -1;
+    return value;
+}
+
+void FrameFences::release() {
+    while (count > 0) {
+        int oldest = (head + MAX_FRAMES - count) % MAX_FRAMES;
+        glDeleteSync(fences[oldest]);
+        count--;
+    }
+}
+
+/* Wait up to timeout ns for the oldest frame, returns false if it is still in flight */
+bool FrameFences::retireOldest(GLuint64 timeout) {
+    int oldest = (head + MAX_FRAMES - count) % MAX_FRAMES;
+
+    // The flush bit makes sure the fence is actually submitted, otherwise we could wait forever
+    GLenum result = glClientWaitSync(fences[oldest], GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    if (result == GL_TIMEOUT_EXPIRED && timeout == 0) return false;
+
+    // A wait that failed or timed out still retires the frame, holding on to it would stall every frame after
+    if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+        latency = chrono::duration<double, milli>(Clock::now() - inputTimes[oldest]).count();
+    }
+
+    glDeleteSync(fences[oldest]);
+    count--;
+    return true;
+}
@@ -0,0 +1,51 @@
+/**
+frame_fences.h
+Caps the number of frames the driver may queue ahead of the GPU using fence
+syncs, and estimates input-to-present latency from when each fence signals
+*/
+#pragma once
+
+#include <glad/glad.h>
+
+#include "frame_pacer.h"
+
+class FrameFences {
+public:
+    typedef FramePacer::Clock Clock;
+
+    static const int MAX_FRAMES = 8;
+
+    FrameFences();
+
+    /* 1 to MAX_FRAMES, or 0 to only measure latency without holding the CPU back */
+    void setMaxFramesInFlight(int frames);
+
+    int getMaxFramesInFlight() const {
+        return limit;
+    }
+
+    /* Before rendering: block until fewer than the limit of frames are still queued */
+    void throttle();
+
+    /* After the swap: fence the frame, inputTime is when the input it shows was sampled */
+    void submit(Clock::time_point inputTime);
+
+    /* Retire every frame the GPU has finished, without blocking */
+    void collect();
+
+    /* Latency in ms of the most recently retired frame, -1 if no frame retired since the last call */
+    double takeLatency();
+
+    /* Delete outstanding fences, the context that created them must be current */
+    void release();
+
+private:
+    GLsync fences[MAX_FRAMES];
+    Clock::time_point inputTimes[MAX_FRAMES];
+    int head;
+    int count;
+    int limit;
+    double latency;
+
+    bool retireOldest(GLuint64 timeout);
+};
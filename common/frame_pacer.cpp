@@ -0,0 +1,94 @@
+/**
+  frame_pacer.cpp
+  Fixed-timestep clock and hybrid sleep/spin frame limiter
+  */
+
+#include "frame_pacer.h"
+
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+/* Time left before a deadline at which we stop sleeping and start spinning.
+   Sleeps routinely overshoot by a millisecond or more, spinning does not. */
+static const FramePacer::Clock::duration SPIN_THRESHOLD = microseconds(2000);
+
+/* Longest frame time fed into the accumulator, stops a stall (breakpoint,
+   window drag) from triggering hundreds of catch-up steps */
+static const double MAX_FRAME_TIME = 0.25;
+
+FramePacer::FramePacer() {
+    this->framePeriod = Clock::duration::zero();
+    this->timestep = 1.0 / 60.0;
+    this->lockstep = false;
+    reset();
+}
+
+void FramePacer::setTargetFPS(double fps) {
+    if (fps > 0) {
+        framePeriod = duration_cast<Clock::duration>(duration<double>(1.0 / fps));
+    } else {
+        framePeriod = Clock::duration::zero();
+    }
+    nextDeadline = Clock::now() + framePeriod;
+}
+
+void FramePacer::setFixedTimestep(double seconds) {
+    if (seconds > 0) {
+        timestep = seconds;
+    }
+}
+
+void FramePacer::reset() {
+    lastAdvance = Clock::now();
+    nextDeadline = lastAdvance + framePeriod;
+    accumulator = 0;
+    stepsTaken = 0;
+}
+
+int FramePacer::advance() {
+    Clock::time_point now = Clock::now();
+    double frameTime = duration<double>(now - lastAdvance).count();
+    lastAdvance = now;
+
+    if (lockstep) {
+        stepsTaken++;
+        return 1;
+    }
+
+    if (frameTime > MAX_FRAME_TIME) frameTime = MAX_FRAME_TIME;
+    accumulator += frameTime;
+
+    int steps = 0;
+    while (accumulator >= timestep) {
+        accumulator -= timestep;
+        steps++;
+    }
+    stepsTaken += steps;
+    return steps;
+}
+
+void FramePacer::waitForNextFrame() {
+    if (framePeriod == Clock::duration::zero()) return;
+
+    Clock::time_point now = Clock::now();
+
+    // Sleep in one go until we are close to the deadline
+    if (nextDeadline - now > SPIN_THRESHOLD) {
+        this_thread::sleep_for(nextDeadline - now - SPIN_THRESHOLD);
+    }
+
+    // Spin out the remainder, yielding so a shared core is not monopolised
+    while ((now = Clock::now()) < nextDeadline) {
+        this_thread::yield();
+    }
+
+    // Schedule from the previous deadline rather than from now so errors do not
+    // accumulate. If we fell more than a frame behind, resynchronise instead of
+    // rushing out a burst of frames.
+    nextDeadline += framePeriod;
+    if (nextDeadline < now) {
+        nextDeadline = now + framePeriod;
+    }
+}
@@ -0,0 +1,64 @@
+/**
+frame_pacer.h
+Fixed-timestep clock and frame rate limiter used by GLWrapper::eventLoop()
+*/
+#pragma once
+
+#include <chrono>
+
+class FramePacer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    FramePacer();
+
+    /* Target presentation rate, <= 0 disables the limiter */
+    void setTargetFPS(double fps);
+
+    /* Length of one simulation step in seconds */
+    void setFixedTimestep(double seconds);
+
+    double getFixedTimestep() const {
+        return timestep;
+    }
+
+    /* Lockstep: every advance() is exactly one step whatever the real time, so the simulation
+       follows the frame count and runs are reproducible. The frame rate limit still applies. */
+    void setLockstep(bool enable) {
+        this->lockstep = enable;
+    }
+
+    bool isLockstep() const {
+        return lockstep;
+    }
+
+    /* Simulation time in seconds, the number of steps taken since the last reset() times the step */
+    double getSimulationTime() const {
+        return stepsTaken * timestep;
+    }
+
+    /* Restart the clocks, e.g. after a long stall such as loading */
+    void reset();
+
+    /* Advance the simulation clock by the real time elapsed since the last call.
+       Returns the number of fixed steps that are now due. */
+    int advance();
+
+    /* Fraction of a step left in the accumulator, for interpolating between states */
+    double getAlpha() const {
+        return accumulator / timestep;
+    }
+
+    /* Block until the next frame deadline: sleep for the bulk of the wait,
+       then spin for the last part to avoid the OS scheduler's wake-up jitter */
+    void waitForNextFrame();
+
+private:
+    Clock::duration framePeriod;
+    Clock::time_point lastAdvance;
+    Clock::time_point nextDeadline;
+    double timestep;
+    double accumulator;
+    long long stepsTaken;
+    bool lockstep;
+};
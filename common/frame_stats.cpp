@@ -0,0 +1,165 @@
+/**
+  frame_stats.cpp
+  Percentile, histogram and file output for FrameStats. None of this runs in
+  the frame loop, so it is free to allocate.
+  */
+
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <string>
+
+using namespace std;
+
+static const int HISTOGRAM_BINS = 16;
+static const int HISTOGRAM_WIDTH = 50;
+
+FrameStats::FrameStats(size_t capacity) : samples(capacity > 0 ? capacity : 1) {
+    clear();
+}
+
+void FrameStats::clear() {
+    head = 0;
+    count = 0;
+    total = 0;
+}
+
+/* Unknown values are written as an empty CSV field or a JSON null */
+static void writeValue(ostream &out, double value, const char *unknown) {
+    if (value < 0) {
+        out << unknown;
+    } else {
+        out << value;
+    }
+}
+
+/* Nearest-rank percentile of an already sorted column */
+static double percentile(const vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t) (p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[min(rank, sorted.size() - 1)];
+}
+
+FrameStats::Summary FrameStats::summarise(double Sample::*column) const {
+    vector<double> values;
+    values.reserve(count);
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        double v = at(i).*column;
+        if (v < 0) continue;
+        values.push_back(v);
+        sum += v;
+    }
+    sort(values.begin(), values.end());
+
+    Summary s;
+    s.p50 = percentile(values, 50);
+    s.p90 = percentile(values, 90);
+    s.p99 = percentile(values, 99);
+    s.max = values.empty() ? 0 : values.back();
+    s.mean = values.empty() ? 0 : sum / values.size();
+    s.samples = values.size();
+    return s;
+}
+
+void FrameStats::report(ostream &out) const {
+    if (count == 0) {
+        out << "Frame stats: no frames recorded" << endl;
+        return;
+    }
+
+    struct Column {
+        const char *name;
+        double Sample::*member;
+    };
+    const Column columns[] = {
+        {"frame", &Sample::frame},
+        {"render", &Sample::render},
+        {"swap", &Sample::swap},
+        {"poll", &Sample::poll},
+        {"latency", &Sample::latency},
+    };
+
+    out << "Frame stats over the last " << count << " of " << total << " frames (ms)" << endl;
+    // The caller's stream keeps its own number format once the report is done
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    out << fixed << setprecision(3);
+    out << "          " << setw(9) << "p50" << setw(9) << "p90" << setw(9) << "p99"
+            << setw(9) << "max" << setw(9) << "mean" << endl;
+    for (const Column &c : columns) {
+        Summary s = summarise(c.member);
+        if (s.samples == 0) continue;
+        out << setw(10) << left << c.name << right << setw(9) << s.p50 << setw(9) << s.p90
+                << setw(9) << s.p99 << setw(9) << s.max << setw(9) << s.mean << endl;
+    }
+
+    // Pick a round bin width so the bulk of the distribution (up to p99) spans the histogram,
+    // everything slower lands in the last bin
+    Summary frame = summarise(&Sample::frame);
+    const double widths[] = {0.1, 0.25, 0.5, 1, 2, 5, 10, 25, 50, 100};
+    double binWidth = widths[0];
+    for (double w : widths) {
+        binWidth = w;
+        if (frame.p99 < w * (HISTOGRAM_BINS - 1)) break;
+    }
+
+    size_t bins[HISTOGRAM_BINS] = {0};
+    size_t tallest = 0;
+    for (size_t i = 0; i < count; i++) {
+        int bin = min((int) (at(i).frame / binWidth), HISTOGRAM_BINS - 1);
+        tallest = max(tallest, ++bins[bin]);
+    }
+
+    out << "Frame time histogram" << endl;
+    for (int b = 0; b < HISTOGRAM_BINS; b++) {
+        if (bins[b] == 0) continue;
+        out << setw(8) << b * binWidth << (b == HISTOGRAM_BINS - 1 ? "+   " : " ms ")
+                << setw(7) << bins[b] << " " << string(bins[b] * HISTOGRAM_WIDTH / tallest, '#') << endl;
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
+
+bool FrameStats::writeCSV(const char *path) const {
+    ofstream file(path);
+    if (!file.is_open()) return false;
+
+    file << "frame,frame_ms,render_ms,swap_ms,poll_ms,latency_ms\n";
+    size_t first = total - count;
+    for (size_t i = 0; i < count; i++) {
+        const Sample &s = at(i);
+        file << first + i << "," << s.frame << "," << s.render << "," << s.swap << "," << s.poll << ",";
+        writeValue(file, s.latency, "");
+        file << "\n";
+    }
+    return file.good();
+}
+
+bool FrameStats::writeJSON(const char *path) const {
+    ofstream file(path);
+    if (!file.is_open()) return false;
+
+    Summary frame = summarise(&Sample::frame);
+    Summary latency = summarise(&Sample::latency);
+    file << "{\n";
+    file << "  \"frames\": " << count << ",\n";
+    file << "  \"frame_ms\": {\"p50\": " << frame.p50 << ", \"p90\": " << frame.p90 << ", \"p99\": "
+            << frame.p99 << ", \"max\": " << frame.max << ", \"mean\": " << frame.mean << "},\n";
+    if (latency.samples > 0) {
+        file << "  \"latency_ms\": {\"p50\": " << latency.p50 << ", \"p90\": " << latency.p90 << ", \"p99\": "
+                << latency.p99 << ", \"max\": " << latency.max << ", \"mean\": " << latency.mean << "},\n";
+    }
+    file << "  \"samples\": [\n";
+    for (size_t i = 0; i < count; i++) {
+        const Sample &s = at(i);
+        file << "    {\"frame_ms\": " << s.frame << ", \"render_ms\": " << s.render << ", \"swap_ms\": "
+                << s.swap << ", \"poll_ms\": " << s.poll << ", \"latency_ms\": ";
+        writeValue(file, s.latency, "null");
+        file << "}" << (i + 1 < count ? ",\n" : "\n");
+    }
+    file << "  ]\n}\n";
+    return file.good();
+}
@@ -0,0 +1,75 @@
+/**
+frame_stats.h
+Per-frame timing samples kept in a fixed-size ring buffer, with percentile
+reporting and CSV/JSON export. Recording a frame never allocates.
+*/
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+class FrameStats {
+public:
+    /* One frame, all times in milliseconds */
+    struct Sample {
+        double frame;   // Start of this frame to start of the next
+        double render;  // Renderer callback
+        double swap;    // glfwSwapBuffers (or glFlush when headless)
+        double poll;    // glfwPollEvents
+        double latency; // Estimated input-to-present latency of the latest frame the GPU finished, < 0 if unknown
+    };
+
+    /* Summary of one column of samples */
+    struct Summary {
+        double p50;
+        double p90;
+        double p99;
+        double max;
+        double mean;
+        size_t samples; // Values that went into the summary, unknown (negative) values are skipped
+    };
+
+    explicit FrameStats(size_t capacity = 4096);
+
+    /* Store a sample, overwriting the oldest one once the buffer is full */
+    void record(const Sample &sample) {
+        samples[head] = sample;
+        head = (head + 1) % samples.size();
+        if (count < samples.size()) count++;
+        total++;
+    }
+
+    void clear();
+
+    /* Samples currently held, at most the capacity */
+    size_t size() const {
+        return count;
+    }
+
+    /* Frames recorded since the last clear(), including overwritten ones */
+    size_t recorded() const {
+        return total;
+    }
+
+    /* i = 0 is the oldest sample still held */
+    const Sample &at(size_t i) const {
+        return samples[(head + samples.size() - count + i) % samples.size()];
+    }
+
+    /* Percentiles over one column, selected with a pointer to member, e.g. &Sample::render */
+    Summary summarise(double Sample::*column) const;
+
+    /* Print percentiles for every column and a histogram of frame times */
+    void report(std::ostream &out) const;
+
+    bool writeCSV(const char *path) const;
+
+    bool writeJSON(const char *path) const;
+
+private:
+    std::vector<Sample> samples;
+    size_t head;
+    size_t count;
+    size_t total;
+};
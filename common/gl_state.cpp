@@ -0,0 +1,163 @@
+/**
+  gl_state.cpp
+  Every setter compares with the shadow copy first; unknown values never compare equal
+  */
+
+#include "gl_state.h"
+
+using namespace std;
+
+static const GLenum CAPABILITIES[] = {
+        GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_SCISSOR_TEST, GL_STENCIL_TEST, GL_PROGRAM_POINT_SIZE,
+        GL_MULTISAMPLE
+};
+
+static const GLenum TEXTURE_TARGET_LIST[] = {
+        GL_TEXTURE_2D, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY
+};
+
+GLState::GLState() {
+    resetCounts();
+    invalidate();
+}
+
+void GLState::resetCounts() {
+    frame = {0, 0};
+    lastFrame = {0, 0};
+    total = {0, 0};
+    frames = 0;
+}
+
+void GLState::invalidate() {
+    program = UNKNOWN;
+    pipeline = UNKNOWN;
+    vao = UNKNOWN;
+    arrayBuffer = UNKNOWN;
+    elementBuffer = UNKNOWN;
+    for (int &capability : capabilities) capability = -1;
+    blendSource = blendDestination = UNKNOWN;
+    viewportKnown = false;
+    clearKnown = false;
+    activeUnit = UNKNOWN;
+    for (auto &unit : textures) {
+        for (GLuint &texture : unit) texture = UNKNOWN;
+    }
+}
+
+void GLState::useProgram(GLuint program) {
+    if (change(this->program, program)) glUseProgram(program);
+}
+
+void GLState::bindProgramPipeline(GLuint pipeline) {
+    if (change(this->pipeline, pipeline)) glBindProgramPipeline(pipeline);
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+    if (!change(this->vao, vao)) return;
+    glBindVertexArray(vao);
+    elementBuffer = UNKNOWN;
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer) {
+    if (target == GL_ARRAY_BUFFER) {
+        if (change(arrayBuffer, buffer)) glBindBuffer(target, buffer);
+    } else if (target == GL_ELEMENT_ARRAY_BUFFER) {
+        if (change(elementBuffer, buffer)) glBindBuffer(target, buffer);
+    } else {
+        frame.calls++;
+        glBindBuffer(target, buffer);
+    }
+}
+
+void GLState::setCapability(GLenum capability, bool enabled) {
+    frame.calls++;
+    for (int i = 0; i < CAPABILITY_COUNT; i++) {
+        if (CAPABILITIES[i] != capability) continue;
+        if (capabilities[i] == (enabled ? 1 : 0)) {
+            frame.elided++;
+            return;
+        }
+        capabilities[i] = enabled ? 1 : 0;
+        break;
+    }
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+}
+
+void GLState::enable(GLenum capability) {
+    setCapability(capability, true);
+}
+
+void GLState::disable(GLenum capability) {
+    setCapability(capability, false);
+}
+
+void GLState::blendFunc(GLenum source, GLenum destination) {
+    frame.calls++;
+    if (source == blendSource && destination == blendDestination) {
+        frame.elided++;
+        return;
+    }
+    blendSource = source;
+    blendDestination = destination;
+    glBlendFunc(source, destination);
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    frame.calls++;
+    if (viewportKnown && viewportRect[0] == x && viewportRect[1] == y
+        && viewportRect[2] == width && viewportRect[3] == height) {
+        frame.elided++;
+        return;
+    }
+    viewportRect[0] = x;
+    viewportRect[1] = y;
+    viewportRect[2] = width;
+    viewportRect[3] = height;
+    viewportKnown = true;
+    glViewport(x, y, width, height);
+}
+
+void GLState::clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+    frame.calls++;
+    if (clearKnown && clear[0] == r && clear[1] == g && clear[2] == b && clear[3] == a) {
+        frame.elided++;
+        return;
+    }
+    clear[0] = r;
+    clear[1] = g;
+    clear[2] = b;
+    clear[3] = a;
+    clearKnown = true;
+    glClearColor(r, g, b, a);
+}
+
+void GLState::bindTexture(GLuint unit, GLenum target, GLuint texture) {
+    int slot = -1;
+    for (int i = 0; i < TEXTURE_TARGETS; i++) {
+        if (TEXTURE_TARGET_LIST[i] == target) slot = i;
+    }
+    if (unit < (GLuint) MAX_TEXTURE_UNITS && slot >= 0) {
+        if (!change(textures[unit][slot], texture)) return;
+    } else {
+        frame.calls++;
+    }
+
+    // The active unit only matters for the bind, so it is switched lazily and not counted as a call
+    if (activeUnit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+    glBindTexture(target, texture);
+}
+
+void GLState::endFrame() {
+    lastFrame = frame;
+    total.calls += frame.calls;
+    total.elided += frame.elided;
+    frames++;
+    frame = {0, 0};
+}
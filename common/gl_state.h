@@ -0,0 +1,113 @@
+/**
+gl_state.h
+Shadow copy of the context state that draws change most often: program, program pipeline,
+vertex array, array/element buffer bindings, enabled capabilities, blend function,
+viewport, clear colour and texture bindings. A call that would set a value the context
+already has is dropped before it reaches the driver, and counted, so the stats show how
+many calls per frame were redundant. Every context has its own (GLWrapper::getState()).
+State changed by calling GL directly is not seen; call invalidate() after such code.
+*/
+#pragma once
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+class GLState {
+public:
+    /* Calls made through the tracker, and how many of them were dropped */
+    struct Counts {
+        size_t calls;
+        size_t elided;
+    };
+
+    static const int MAX_TEXTURE_UNITS = 16;
+
+    GLState();
+
+    void useProgram(GLuint program);
+
+    void bindProgramPipeline(GLuint pipeline);
+
+    /* The element array binding belongs to the vertex array, so it is forgotten on a switch */
+    void bindVertexArray(GLuint vao);
+
+    /* GL_ARRAY_BUFFER and GL_ELEMENT_ARRAY_BUFFER are tracked, other targets are passed through */
+    void bindBuffer(GLenum target, GLuint buffer);
+
+    /* GL_BLEND, GL_CULL_FACE, GL_DEPTH_TEST, GL_SCISSOR_TEST, GL_STENCIL_TEST,
+       GL_PROGRAM_POINT_SIZE and GL_MULTISAMPLE are tracked, other capabilities are passed through */
+    void enable(GLenum capability);
+
+    void disable(GLenum capability);
+
+    void blendFunc(GLenum source, GLenum destination);
+
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+    void clearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+
+    /* Bind `texture` to GL_TEXTURE0 + unit, switching the active unit only when needed. 2D, 3D,
+       cube map and 2D array targets on the first MAX_TEXTURE_UNITS units are tracked. */
+    void bindTexture(GLuint unit, GLenum target, GLuint texture);
+
+    /* Forget everything, e.g. after code that changes state with direct GL calls */
+    void invalidate();
+
+    /* Close the current frame's counts, called by GLWrapper after the renderer */
+    void endFrame();
+
+    /* Zero the counts and the frame count, e.g. once warmup frames are over. The shadow copy is kept. */
+    void resetCounts();
+
+    /* Counts of the last finished frame */
+    Counts getLastFrame() const {
+        return lastFrame;
+    }
+
+    /* Counts summed over all frames ended so far */
+    Counts getTotal() const {
+        return total;
+    }
+
+    size_t getFrames() const {
+        return frames;
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xffffffff;
+    static const int CAPABILITY_COUNT = 7;
+    static const int TEXTURE_TARGETS = 4;
+
+    GLuint program;
+    GLuint pipeline;
+    GLuint vao;
+    GLuint arrayBuffer;
+    GLuint elementBuffer;
+    int capabilities[CAPABILITY_COUNT]; // 0 disabled, 1 enabled, -1 unknown
+    GLenum blendSource, blendDestination;
+    GLint viewportRect[4];
+    bool viewportKnown;
+    GLfloat clear[4];
+    bool clearKnown;
+    GLuint activeUnit;
+    GLuint textures[MAX_TEXTURE_UNITS][TEXTURE_TARGETS];
+
+    Counts frame;
+    Counts lastFrame;
+    Counts total;
+    size_t frames;
+
+    /* Count a call, true if it has to be made */
+    bool change(GLuint &current, GLuint value) {
+        frame.calls++;
+        if (current == value) {
+            frame.elided++;
+            return false;
+        }
+        current = value;
+        return true;
+    }
+
+    void setCapability(GLenum capability, bool enabled);
+};
@@ -0,0 +1,78 @@
+/*
+    glad_manifest.c
+    Manifest loader for the glad generated GL bindings in glad.c. The name to
+    function pointer table is generated from glad.c when CMake configures.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "glad_manifest.h"
+
+struct GladEntry {
+    const char *name;
+    void **pointer;
+};
+
+/* Sorted by name so lookups can use bsearch() */
+#define GLAD_ENTRY(name) {#name, (void **) &glad_##name},
+static const struct GladEntry gladEntries[] = {
+#include "glad_table.inc"
+};
+#undef GLAD_ENTRY
+
+static const int gladEntryCount = sizeof(gladEntries) / sizeof(gladEntries[0]);
+
+static int compare_entry(const void *key, const void *entry) {
+    return strcmp((const char *) key, ((const struct GladEntry *) entry)->name);
+}
+
+static void set_version_flags(int major, int minor) {
+    struct {
+        int *flag;
+        int major;
+        int minor;
+    } versions[] = {
+        {&GLAD_GL_VERSION_1_0, 1, 0}, {&GLAD_GL_VERSION_1_1, 1, 1}, {&GLAD_GL_VERSION_1_2, 1, 2},
+        {&GLAD_GL_VERSION_1_3, 1, 3}, {&GLAD_GL_VERSION_1_4, 1, 4}, {&GLAD_GL_VERSION_1_5, 1, 5},
+        {&GLAD_GL_VERSION_2_0, 2, 0}, {&GLAD_GL_VERSION_2_1, 2, 1}, {&GLAD_GL_VERSION_3_0, 3, 0},
+        {&GLAD_GL_VERSION_3_1, 3, 1}, {&GLAD_GL_VERSION_3_2, 3, 2}, {&GLAD_GL_VERSION_3_3, 3, 3},
+        {&GLAD_GL_VERSION_4_0, 4, 0}, {&GLAD_GL_VERSION_4_1, 4, 1}, {&GLAD_GL_VERSION_4_2, 4, 2},
+        {&GLAD_GL_VERSION_4_3, 4, 3}, {&GLAD_GL_VERSION_4_4, 4, 4}, {&GLAD_GL_VERSION_4_5, 4, 5},
+        {&GLAD_GL_VERSION_4_6, 4, 6},
+    };
+    int i;
+
+    for (i = 0; i < (int) (sizeof(versions) / sizeof(versions[0])); i++) {
+        *versions[i].flag = major > versions[i].major || (major == versions[i].major && minor >= versions[i].minor);
+    }
+}
+
+int gladLoadGLManifest(GLADloadproc load, const char *const *names, int count) {
+    int i, resolved = 0;
+    GLint major = 0, minor = 0;
+
+    GLVersion.major = 0; GLVersion.minor = 0;
+    glad_glGetString = (PFNGLGETSTRINGPROC) load("glGetString");
+    glad_glGetIntegerv = (PFNGLGETINTEGERVPROC) load("glGetIntegerv");
+    if (glad_glGetString == NULL || glad_glGetIntegerv == NULL) return 0;
+    if (glGetString(GL_VERSION) == NULL) return 0;
+
+    /* GL_MAJOR_VERSION is a 3.0 query, all the contexts we create are 4.1 or later */
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major == 0) return 0;
+    GLVersion.major = major; GLVersion.minor = minor;
+    set_version_flags(major, minor);
+
+    for (i = 0; i < count; i++) {
+        const struct GladEntry *entry = (const struct GladEntry *) bsearch(
+                names[i], gladEntries, gladEntryCount, sizeof(struct GladEntry), compare_entry);
+        if (entry == NULL) continue;
+
+        *entry->pointer = load(entry->name);
+        if (*entry->pointer != NULL) resolved++;
+    }
+
+    return resolved + 2;
+}
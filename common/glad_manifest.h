@@ -0,0 +1,26 @@
+/**
+glad_manifest.h
+Loader that resolves only the GL entry points a program references, instead of
+every function from GL 1.0 to 4.6 like gladLoadGLLoader(). The name list for each
+target is generated by cmake/gl_manifest.cmake from the target's sources.
+*/
+#pragma once
+
+#include <glad/glad.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Resolve glGetString, glGetIntegerv and the named functions, and set GLVersion and the
+   GLAD_GL_VERSION_x flags. Names glad does not know are skipped. Returns the number of
+   functions resolved, 0 if no usable context is current. */
+int gladLoadGLManifest(GLADloadproc load, const char *const *names, int count);
+
+/* The calling target's manifest, defined in the generated <target>_gl_manifest.c */
+extern const char *const gladManifestNames[];
+extern const int gladManifestCount;
+
+#ifdef __cplusplus
+}
+#endif
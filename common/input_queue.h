@@ -0,0 +1,92 @@
+/**
+input_queue.h
+Timestamped GLFW input events and the bounded single producer / single consumer
+ring that carries them from the GLFW callbacks to whichever thread consumes input
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+#include "frame_pacer.h"
+
+struct InputEvent {
+    enum Type {
+        KEY,            // code = key, scancode, action, mods
+        MOUSE_BUTTON,   // code = button, action, mods, x/y = cursor position
+        CURSOR,         // x/y = cursor position
+        SCROLL          // x/y = scroll offsets
+    };
+
+    Type type;
+    int code;
+    int scancode;
+    int action;
+    int mods;
+    double x;
+    double y;
+    FramePacer::Clock::time_point time; // When the GLFW callback saw the event
+};
+
+/* A batch of events handed to the consumer, valid until the next batch is taken */
+struct InputEvents {
+    const InputEvent *events;
+    size_t count;
+
+    const InputEvent *begin() const {
+        return events;
+    }
+
+    const InputEvent *end() const {
+        return events + count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+};
+
+/* Lock-free bounded ring, one thread may push and one (possibly different) thread may pop.
+   CAPACITY must be a power of two. */
+template<typename T, size_t CAPACITY>
+class SpscRing {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    SpscRing() : head(0), tail(0) {
+    }
+
+    /* Producer: returns false and drops the item if the ring is full */
+    bool push(const T &item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == CAPACITY) return false;
+
+        items[h & (CAPACITY - 1)] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* Consumer: true if there is nothing to take */
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_relaxed);
+    }
+
+    /* Consumer: move up to maxCount items into out, returns how many were taken */
+    size_t popAll(T *out, size_t maxCount) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t available = head.load(std::memory_order_acquire) - t;
+        size_t n = available < maxCount ? available : maxCount;
+
+        for (size_t i = 0; i < n; i++) {
+            out[i] = items[(t + i) & (CAPACITY - 1)];
+        }
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+private:
+    // Indices on separate cache lines so producer and consumer do not contend
+    T items[CAPACITY];
+    alignas(64) std::atomic<size_t> head; // Next slot to write, only advanced by the producer
+    alignas(64) std::atomic<size_t> tail; // Next slot to read, only advanced by the consumer
+};
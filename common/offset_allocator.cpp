@@ -0,0 +1,214 @@
+/**
+  offset_allocator.cpp
+  Size classes are a small float: sizes below 8 have a class each, larger sizes share a
+  class with everything that has the same top 4 significant bits
+  */
+
+#include "offset_allocator.h"
+
+using namespace std;
+
+static const uint32_t MANTISSA_BITS = 3;
+static const uint32_t MANTISSA_VALUE = 1 << MANTISSA_BITS;
+static const uint32_t MANTISSA_MASK = MANTISSA_VALUE - 1;
+
+static uint32_t highestBit(uint32_t value) {
+    uint32_t bit = 0;
+    while (value >>= 1) bit++;
+    return bit;
+}
+
+static uint32_t lowestBit(uint32_t value) {
+    uint32_t bit = 0;
+    while (!(value & 1)) {
+        value >>= 1;
+        bit++;
+    }
+    return bit;
+}
+
+/* Lowest set bit at or above `start`, NO_SPACE if there is none */
+static uint32_t lowestBitFrom(uint32_t mask, uint32_t start) {
+    if (start >= 32) return OffsetAllocator::NO_SPACE;
+    uint32_t masked = mask & ~((1u << start) - 1);
+    return masked ? lowestBit(masked) : OffsetAllocator::NO_SPACE;
+}
+
+/* Smallest class whose every region can hold `size`, for allocating */
+static uint32_t classRoundUp(uint32_t size) {
+    if (size < MANTISSA_VALUE) return size;
+    uint32_t mantissaStart = highestBit(size) - MANTISSA_BITS;
+    uint32_t mantissa = (size >> mantissaStart) & MANTISSA_MASK;
+    if (size & ((1u << mantissaStart) - 1)) mantissa++;
+    // A mantissa that overflows carries into the exponent, which is the next class up
+    return ((mantissaStart + 1) << MANTISSA_BITS) + mantissa;
+}
+
+/* Class a free region of `size` is filed under */
+static uint32_t classRoundDown(uint32_t size) {
+    if (size < MANTISSA_VALUE) return size;
+    uint32_t mantissaStart = highestBit(size) - MANTISSA_BITS;
+    uint32_t mantissa = (size >> mantissaStart) & MANTISSA_MASK;
+    return ((mantissaStart + 1) << MANTISSA_BITS) | mantissa;
+}
+
+OffsetAllocator::OffsetAllocator(uint32_t capacity) {
+    this->capacity = capacity;
+    this->freeUnits = 0;
+    this->freeRegions = 0;
+    this->usedTop = 0;
+    for (uint8_t &leaf : usedLeaf) leaf = 0;
+    for (uint32_t &head : binHeads) head = UNUSED;
+
+    if (capacity > 0) insertFree(0, capacity);
+}
+
+uint32_t OffsetAllocator::newNode() {
+    if (spareNodes.empty()) {
+        nodes.push_back(Node());
+        return (uint32_t) nodes.size() - 1;
+    }
+    uint32_t index = spareNodes.back();
+    spareNodes.pop_back();
+    return index;
+}
+
+uint32_t OffsetAllocator::insertFree(uint32_t offset, uint32_t size) {
+    uint32_t bin = classRoundDown(size);
+    uint32_t top = bin / LEAF_BINS;
+    uint32_t leaf = bin % LEAF_BINS;
+    usedTop |= 1u << top;
+    usedLeaf[top] |= 1u << leaf;
+
+    uint32_t index = newNode();
+    Node &node = nodes[index];
+    node.offset = offset;
+    node.size = size;
+    node.binPrev = UNUSED;
+    node.binNext = binHeads[bin];
+    node.neighbourPrev = UNUSED;
+    node.neighbourNext = UNUSED;
+    node.used = false;
+    if (node.binNext != UNUSED) nodes[node.binNext].binPrev = index;
+    binHeads[bin] = index;
+
+    freeUnits += size;
+    freeRegions++;
+    return index;
+}
+
+void OffsetAllocator::removeFree(uint32_t index) {
+    Node &node = nodes[index];
+    if (node.binPrev != UNUSED) {
+        nodes[node.binPrev].binNext = node.binNext;
+    } else {
+        uint32_t bin = classRoundDown(node.size);
+        binHeads[bin] = node.binNext;
+        if (node.binNext == UNUSED) {
+            uint32_t top = bin / LEAF_BINS;
+            usedLeaf[top] &= ~(1u << (bin % LEAF_BINS));
+            if (!usedLeaf[top]) usedTop &= ~(1u << top);
+        }
+    }
+    if (node.binNext != UNUSED) nodes[node.binNext].binPrev = node.binPrev;
+
+    freeUnits -= node.size;
+    freeRegions--;
+    spareNodes.push_back(index);
+}
+
+OffsetAllocator::Allocation OffsetAllocator::allocate(uint32_t size) {
+    Allocation allocation = {NO_SPACE, NO_SPACE};
+    if (size == 0 || size > freeUnits) return allocation;
+
+    // First class that is large enough: in the same top bin if it has one, else the next used top bin
+    uint32_t minBin = classRoundUp(size);
+    uint32_t top = minBin / LEAF_BINS;
+    uint32_t leaf = NO_SPACE;
+    if (top < TOP_BINS && (usedTop & (1u << top))) leaf = lowestBitFrom(usedLeaf[top], minBin % LEAF_BINS);
+    if (leaf == NO_SPACE) {
+        top = lowestBitFrom(usedTop, top + 1);
+        if (top == NO_SPACE) return allocation;
+        leaf = lowestBit(usedLeaf[top]);
+    }
+
+    uint32_t index = binHeads[top * LEAF_BINS + leaf];
+    uint32_t offset = nodes[index].offset;
+    uint32_t regionSize = nodes[index].size;
+    uint32_t neighbourPrev = nodes[index].neighbourPrev;
+    uint32_t neighbourNext = nodes[index].neighbourNext;
+    removeFree(index);
+
+    // The free node is reused for the allocation, so it keeps its place among its neighbours
+    spareNodes.pop_back();
+    Node &node = nodes[index];
+    node.size = size;
+    node.used = true;
+    node.neighbourPrev = neighbourPrev;
+    node.neighbourNext = neighbourNext;
+
+    if (regionSize > size) {
+        uint32_t rest = insertFree(offset + size, regionSize - size);
+        nodes[rest].neighbourPrev = index;
+        nodes[rest].neighbourNext = neighbourNext;
+        if (neighbourNext != UNUSED) nodes[neighbourNext].neighbourPrev = rest;
+        nodes[index].neighbourNext = rest;
+    }
+
+    allocation.offset = offset;
+    allocation.node = index;
+    return allocation;
+}
+
+void OffsetAllocator::free(const Allocation &allocation) {
+    if (allocation.node >= nodes.size() || !nodes[allocation.node].used) return;
+
+    Node &node = nodes[allocation.node];
+    uint32_t offset = node.offset;
+    uint32_t size = node.size;
+    uint32_t neighbourPrev = node.neighbourPrev;
+    uint32_t neighbourNext = node.neighbourNext;
+    node.used = false;
+    spareNodes.push_back(allocation.node);
+
+    if (neighbourPrev != UNUSED && !nodes[neighbourPrev].used) {
+        offset = nodes[neighbourPrev].offset;
+        size += nodes[neighbourPrev].size;
+        uint32_t before = nodes[neighbourPrev].neighbourPrev;
+        removeFree(neighbourPrev);
+        neighbourPrev = before;
+    }
+    if (neighbourNext != UNUSED && !nodes[neighbourNext].used) {
+        size += nodes[neighbourNext].size;
+        uint32_t after = nodes[neighbourNext].neighbourNext;
+        removeFree(neighbourNext);
+        neighbourNext = after;
+    }
+
+    uint32_t merged = insertFree(offset, size);
+    nodes[merged].neighbourPrev = neighbourPrev;
+    nodes[merged].neighbourNext = neighbourNext;
+    if (neighbourPrev != UNUSED) nodes[neighbourPrev].neighbourNext = merged;
+    if (neighbourNext != UNUSED) nodes[neighbourNext].neighbourPrev = merged;
+}
+
+uint32_t OffsetAllocator::getLargestFree() const {
+    if (!usedTop) return 0;
+
+    // Regions in one class differ by less than the class width, so scan the highest class
+    uint32_t top = highestBit(usedTop);
+    uint32_t bin = top * LEAF_BINS + highestBit(usedLeaf[top]);
+    uint32_t largest = 0;
+    for (uint32_t index = binHeads[bin]; index != UNUSED; index = nodes[index].binNext) {
+        if (nodes[index].size > largest) largest = nodes[index].size;
+    }
+    return largest;
+}
+
+bool OffsetAllocator::isPacked() const {
+    if (freeRegions == 0) return true;
+    if (freeRegions > 1) return false;
+    uint32_t top = highestBit(usedTop);
+    const Node &region = nodes[binHeads[top * LEAF_BINS + highestBit(usedLeaf[top])]];
+    return region.offset + region.size == capacity;
+}
@@ -0,0 +1,82 @@
+/**
+offset_allocator.h
+Two-level segregated fit (TLSF) allocator of offsets into a range of `capacity` units;
+it never touches memory itself, so it can manage a GPU buffer. Free regions are kept in
+256 size classes (5 exponent bits, 3 mantissa bits) with a bitmap per level, so both
+allocate() and free() take constant time: a couple of bit scans to find a class that
+is large enough, and neighbour links to merge a freed region with free regions next to it.
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class OffsetAllocator {
+public:
+    static const uint32_t NO_SPACE = 0xffffffff;
+
+    /* offset == NO_SPACE if the allocation failed; node is needed to free it */
+    struct Allocation {
+        uint32_t offset;
+        uint32_t node;
+    };
+
+    explicit OffsetAllocator(uint32_t capacity);
+
+    /* `size` units, at any offset. O(1). */
+    Allocation allocate(uint32_t size);
+
+    /* Return an allocation, merging it with free neighbours. O(1). */
+    void free(const Allocation &allocation);
+
+    uint32_t getCapacity() const {
+        return capacity;
+    }
+
+    uint32_t getFree() const {
+        return freeUnits;
+    }
+
+    /* Number of separate free regions, 1 means no fragmentation */
+    uint32_t getFreeRegions() const {
+        return freeRegions;
+    }
+
+    /* Size of the largest free region. allocate() only searches classes that fit any region in them,
+       so a request this large can still fail unless it is at the bottom of its class. */
+    uint32_t getLargestFree() const;
+
+    /* True if all free space is one region at the end, so nothing can move to a lower offset */
+    bool isPacked() const;
+
+private:
+    static const uint32_t UNUSED = 0xffffffff;
+    static const int TOP_BINS = 32;
+    static const int LEAF_BINS = 8;
+
+    struct Node {
+        uint32_t offset;
+        uint32_t size;
+        uint32_t binPrev;       // Free list of the node's size class
+        uint32_t binNext;
+        uint32_t neighbourPrev; // Adjacent regions, used or free, in offset order
+        uint32_t neighbourNext;
+        bool used;
+    };
+
+    uint32_t capacity;
+    uint32_t freeUnits;
+    uint32_t freeRegions;
+    uint32_t usedTop;                   // Bit t set if any class in usedLeaf[t] has a free region
+    uint8_t usedLeaf[TOP_BINS];
+    uint32_t binHeads[TOP_BINS * LEAF_BINS];
+    std::vector<Node> nodes;
+    std::vector<uint32_t> spareNodes;   // Indices of nodes not describing any region
+
+    uint32_t newNode();
+
+    uint32_t insertFree(uint32_t offset, uint32_t size);
+
+    void removeFree(uint32_t index);
+};
@@ -0,0 +1,168 @@
+/**
+  program_cache.cpp
+  Program binary cache. Files are <directory>/<key>.bin holding a small header
+  followed by the binary exactly as glGetProgramBinary returned it.
+  */
+
+#include "program_cache.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+static const uint32_t CACHE_MAGIC = 0x42504c47; // "GLPB"
+static const uint32_t CACHE_VERSION = 1;
+
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;       // Repeated so a renamed or truncated file is never trusted
+    uint32_t format;    // Binary format from glGetProgramBinary
+    uint32_t length;
+};
+
+uint64_t ProgramCache::hash(const void *data, size_t size, uint64_t h) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    for (size_t i = 0; i < size; i++) {
+        h ^= bytes[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+ProgramCache::ProgramCache(const string &directory) : directory(directory) {
+    this->supported = -1;
+    this->hits = 0;
+    this->misses = 0;
+}
+
+bool ProgramCache::isSupported() {
+    if (supported < 0) {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = formats > 0;
+    }
+    return supported != 0;
+}
+
+/* Binaries are only valid for the driver that produced them, every key starts from this */
+static uint64_t driverHash(string &driver) {
+    if (driver.empty()) {
+        driver = string((const char *) glGetString(GL_VENDOR)) + '\n' + (const char *) glGetString(GL_RENDERER)
+                + '\n' + (const char *) glGetString(GL_VERSION);
+    }
+    return ProgramCache::hash(driver.data(), driver.size());
+}
+
+uint64_t ProgramCache::key(const vector<uint64_t> &sourceHashes) {
+    uint64_t h = driverHash(driver);
+    for (uint64_t sourceHash : sourceHashes) h = hash(&sourceHash, sizeof(sourceHash), h);
+    return h;
+}
+
+uint64_t ProgramCache::key(const vector<string> &sources) {
+    uint64_t h = driverHash(driver);
+    for (const string &source : sources) {
+        // Hash the length too, so moving text from one stage to the next changes the key
+        uint64_t length = source.size();
+        h = hash(&length, sizeof(length), h);
+        h = hash(source.data(), source.size(), h);
+    }
+    return h;
+}
+
+string ProgramCache::pathFor(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) key);
+    return (filesystem::path(directory) / name).string();
+}
+
+GLuint ProgramCache::load(uint64_t key, bool separable) {
+    if (!isSupported()) return 0;
+
+    string path = pathFor(key);
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) {
+        misses++;
+        return 0;
+    }
+
+    // The length is checked against the file before anything is allocated for it
+    error_code error;
+    uintmax_t fileSize = filesystem::file_size(path, error);
+    CacheHeader header;
+    vector<char> binary;
+    bool valid = !error && file.read((char *) &header, sizeof(header)) && header.magic == CACHE_MAGIC
+            && header.version == CACHE_VERSION && header.key == key
+            && header.length <= fileSize - sizeof(header);
+    if (valid) {
+        binary.resize(header.length);
+        valid = (bool) file.read(binary.data(), header.length);
+    }
+    file.close();
+
+    GLuint program = 0;
+    if (valid) {
+        program = glCreateProgram();
+        if (separable) glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+        glProgramBinary(program, header.format, binary.data(), (GLsizei) binary.size());
+
+        // The driver may refuse a binary at any time, e.g. after an update that kept the version string
+        GLint status = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status == GL_FALSE) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+
+    if (!program) {
+        error_code ignored;
+        filesystem::remove(path, ignored);
+        misses++;
+        return 0;
+    }
+
+    hits++;
+    return program;
+}
+
+bool ProgramCache::store(uint64_t key, GLuint program) {
+    if (!isSupported()) return false;
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return false;
+
+    vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    error_code error;
+    filesystem::create_directories(directory, error);
+    if (error) {
+        cerr << "Program cache: could not create " << directory << ": " << error.message() << endl;
+        return false;
+    }
+
+    // Write to a temporary file and rename it into place, so another process starting at the
+    // same time never reads half a binary
+    string path = pathFor(key);
+    string temporary = path + ".tmp";
+    {
+        ofstream file(temporary, ios::binary | ios::trunc);
+        CacheHeader header = {CACHE_MAGIC, CACHE_VERSION, key, format, (uint32_t) length};
+        file.write((const char *) &header, sizeof(header));
+        file.write(binary.data(), length);
+        if (!file.good()) {
+            file.close();
+            filesystem::remove(temporary, error);
+            return false;
+        }
+    }
+    filesystem::rename(temporary, path, error);
+    return !error;
+}
@@ -0,0 +1,58 @@
+/**
+program_cache.h
+On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary),
+keyed by a hash of the shader sources and the GL vendor, renderer and version,
+so a driver update or a different GPU never picks up a stale binary
+*/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+class ProgramCache {
+public:
+    /* 64-bit FNV-1a, pass the previous result as h to hash several pieces in sequence */
+    static constexpr uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+    static uint64_t hash(const void *data, size_t size, uint64_t h = FNV_OFFSET);
+
+    /* Binaries are kept in `directory`, which is created when the first one is stored */
+    explicit ProgramCache(const std::string &directory);
+
+    /* False if the driver offers no binary formats, load() and store() then do nothing */
+    bool isSupported();
+
+    /* Cache key for a program built from these sources (in stage order) on the current context */
+    uint64_t key(const std::vector<std::string> &sources);
+
+    /* Cache key from hashes of the sources made elsewhere, e.g. at build time for embedded shaders */
+    uint64_t key(const std::vector<uint64_t> &sourceHashes);
+
+    /* A linked program restored from the cache, or 0 if there is no entry or the driver rejected
+       it. Rejected entries are deleted so the next store() replaces them. Pass separable for
+       single stage programs used in pipelines, the flag has to be set before the binary is loaded. */
+    GLuint load(uint64_t key, bool separable = false);
+
+    /* Save a linked program. Works best if GL_PROGRAM_BINARY_RETRIEVABLE_HINT was set before linking. */
+    bool store(uint64_t key, GLuint program);
+
+    size_t getHits() const {
+        return hits;
+    }
+
+    size_t getMisses() const {
+        return misses;
+    }
+
+private:
+    std::string directory;
+    std::string driver;
+    int supported; // -1 until checked
+    size_t hits;
+    size_t misses;
+
+    std::string pathFor(uint64_t key) const;
+};
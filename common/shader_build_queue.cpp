@@ -0,0 +1,170 @@
+/**
+  shader_build_queue.cpp
+  Asynchronous shader compile and link queue
+  */
+
+#include "shader_build_queue.h"
+
+#include <cstring>
+
+using namespace std;
+
+/* GL_KHR_parallel_shader_compile is not part of the glad profile we generated */
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+/* Let the driver pick how many compiler threads to use */
+static const GLuint DRIVER_DEFAULT_THREADS = 0xFFFFFFFF;
+
+ShaderBuildQueue::ShaderBuildQueue(GLADloadproc load, ProgramCache *cache) {
+    this->cache = cache;
+    this->parallel = false;
+    this->pending = 0;
+
+    const char *extension = nullptr;
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count && !extension; i++) {
+        const char *name = (const char *) glGetStringi(GL_EXTENSIONS, i);
+        if (strcmp(name, "GL_KHR_parallel_shader_compile") == 0) extension = "glMaxShaderCompilerThreadsKHR";
+        if (strcmp(name, "GL_ARB_parallel_shader_compile") == 0) extension = "glMaxShaderCompilerThreadsARB";
+    }
+    if (!extension) return;
+
+    parallel = true;
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxThreads =
+            load ? (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC) load(extension) : nullptr;
+    if (maxThreads) maxThreads(DRIVER_DEFAULT_THREADS);
+}
+
+ShaderBuildQueue::Handle ShaderBuildQueue::submit(const string &vertShaderStr, const string &fragShaderStr,
+                                                  uint64_t cacheKey) {
+    Build build;
+    build.state = BUILDING;
+    build.vertShader = 0;
+    build.fragShader = 0;
+    build.cacheKey = 0;
+
+    if (cache) {
+        build.cacheKey = cacheKey ? cacheKey : cache->key({vertShaderStr, fragShaderStr});
+        build.program = cache->load(build.cacheKey);
+        if (build.program) {
+            build.state = READY;
+            builds.push_back(build);
+            return (Handle) builds.size() - 1;
+        }
+    }
+
+    // Compile and link straight away, nothing is queried until the build is polled,
+    // so the driver is free to work on all submitted programs at the same time
+    const char *vertSource = vertShaderStr.c_str();
+    const char *fragSource = fragShaderStr.c_str();
+    build.vertShader = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(build.vertShader, 1, &vertSource, NULL);
+    glCompileShader(build.vertShader);
+    build.fragShader = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(build.fragShader, 1, &fragSource, NULL);
+    glCompileShader(build.fragShader);
+
+    build.program = glCreateProgram();
+    if (cache) glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(build.program, build.vertShader);
+    glAttachShader(build.program, build.fragShader);
+    glLinkProgram(build.program);
+
+    builds.push_back(build);
+    pending++;
+    return (Handle) builds.size() - 1;
+}
+
+int ShaderBuildQueue::poll() {
+    bool finishedOne = false;
+    for (Build &build : builds) {
+        if (build.state != BUILDING) continue;
+
+        // Without the extension every query may block, so only finish one build per call
+        if (!parallel && finishedOne) break;
+        if (isComplete(build)) {
+            finish(build);
+            finishedOne = true;
+        }
+    }
+    return pending;
+}
+
+ShaderBuildQueue::State ShaderBuildQueue::getState(Handle handle) {
+    Build &build = builds[handle];
+    if (build.state == BUILDING && isComplete(build)) finish(build);
+    return build.state;
+}
+
+GLuint ShaderBuildQueue::getProgram(Handle handle) {
+    return getState(handle) == READY ? builds[handle].program : 0;
+}
+
+GLuint ShaderBuildQueue::wait(Handle handle) {
+    Build &build = builds[handle];
+    if (build.state == BUILDING) finish(build);
+    return build.state == READY ? build.program : 0;
+}
+
+void ShaderBuildQueue::waitAll() {
+    for (Build &build : builds) {
+        if (build.state == BUILDING) finish(build);
+    }
+}
+
+const string &ShaderBuildQueue::getLog(Handle handle) const {
+    return builds[handle].log;
+}
+
+bool ShaderBuildQueue::isComplete(const Build &build) const {
+    if (!parallel) return true;
+
+    GLint done = GL_FALSE;
+    glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+}
+
+/* Collect the results of a build, blocks if the driver has not finished it */
+void ShaderBuildQueue::finish(Build &build) {
+    GLint status = GL_FALSE;
+    glGetProgramiv(build.program, GL_LINK_STATUS, &status);
+
+    if (status == GL_FALSE) {
+        // Report the compile errors if there are any, they explain the failed link
+        GLuint stages[] = {build.vertShader, build.fragShader};
+        const char *names[] = {"vertex", "fragment"};
+        for (int i = 0; i < 2; i++) {
+            GLint compiled = GL_FALSE;
+            glGetShaderiv(stages[i], GL_COMPILE_STATUS, &compiled);
+            if (compiled) continue;
+
+            GLint length = 0;
+            glGetShaderiv(stages[i], GL_INFO_LOG_LENGTH, &length);
+            vector<GLchar> info(length + 1);
+            glGetShaderInfoLog(stages[i], length, NULL, info.data());
+            build.log += string("Compile error in ") + names[i] + "\n\t" + info.data() + "\n";
+        }
+        if (build.log.empty()) {
+            GLint length = 0;
+            glGetProgramiv(build.program, GL_INFO_LOG_LENGTH, &length);
+            vector<GLchar> info(length + 1);
+            glGetProgramInfoLog(build.program, length, NULL, info.data());
+            build.log = string("Linker error: ") + info.data();
+        }
+        glDeleteProgram(build.program);
+        build.program = 0;
+        build.state = FAILED;
+    } else {
+        if (cache) cache->store(build.cacheKey, build.program);
+        build.state = READY;
+    }
+
+    glDeleteShader(build.vertShader);
+    glDeleteShader(build.fragShader);
+    build.vertShader = build.fragShader = 0;
+    pending--;
+}
@@ -0,0 +1,85 @@
+/**
+shader_build_queue.h
+Asynchronous program builds: every program is compiled and linked up front without
+querying the result, and the queue is polled later for the ones that have finished.
+With GL_KHR_parallel_shader_compile (or the ARB version) polling never blocks and the
+driver compiles on its own threads, otherwise poll() finishes one program per call.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "program_cache.h"
+
+class ShaderBuildQueue {
+public:
+    typedef int Handle;
+
+    enum State {
+        BUILDING,
+        READY,
+        FAILED
+    };
+
+    /* load resolves glMaxShaderCompilerThreadsKHR, may be nullptr. Programs are looked up in
+       and saved to cache when one is given. Needs a current context. */
+    explicit ShaderBuildQueue(GLADloadproc load = nullptr, ProgramCache *cache = nullptr);
+
+    /* Cache for programs submitted from now on, nullptr to stop caching */
+    void setCache(ProgramCache *cache) {
+        this->cache = cache;
+    }
+
+    /* True if the driver reports completion without blocking */
+    bool isParallel() const {
+        return parallel;
+    }
+
+    /* Start compiling and linking a program, returns at once. cacheKey, if not 0, replaces the
+       key the cache would compute from the sources. */
+    Handle submit(const std::string &vertShaderStr, const std::string &fragShaderStr, uint64_t cacheKey = 0);
+
+    /* Move finished programs to READY or FAILED, returns how many are still building */
+    int poll();
+
+    /* Without the extension a BUILDING program is finished first, which blocks like wait() */
+    State getState(Handle handle);
+
+    /* The linked program once READY, 0 before that or if the build failed. Blocks like
+       getState() without the extension. */
+    GLuint getProgram(Handle handle);
+
+    /* Block until this program is finished, returns it or 0 if the build failed */
+    GLuint wait(Handle handle);
+
+    void waitAll();
+
+    /* Compile or link errors of a FAILED build */
+    const std::string &getLog(Handle handle) const;
+
+    int getPending() const {
+        return pending;
+    }
+
+private:
+    struct Build {
+        State state;
+        GLuint program;
+        GLuint vertShader;
+        GLuint fragShader;
+        uint64_t cacheKey;
+        std::string log;
+    };
+
+    std::vector<Build> builds;
+    ProgramCache *cache;
+    bool parallel;
+    int pending;
+
+    bool isComplete(const Build &build) const;
+
+    void finish(Build &build);
+};
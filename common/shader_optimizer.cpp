@@ -0,0 +1,443 @@
+/**
+  shader_optimizer.cpp
+  A token level pass over top level GLSL declarations. It does not parse expressions:
+  liveness is "the name is mentioned by something live", which can only keep too much.
+  */
+
+#include "shader_optimizer.h"
+
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct Token {
+    enum Kind {
+        WORD, NUMBER, SYMBOL, DIRECTIVE
+    };
+    Kind kind;
+    string text;
+};
+
+/* A top level declaration, or a preprocessor line between declarations */
+struct Item {
+    enum Kind {
+        DIRECTIVE, FUNCTION, UNIFORM, INPUT, OUTPUT, OTHER
+    };
+    Kind kind = OTHER;
+    vector<Token> tokens;
+    string name;               // For FUNCTION, UNIFORM, INPUT and OUTPUT
+    int location = -1;         // layout(location = N)
+    bool hasDirective = false; // Contains a preprocessor line, always kept as it is
+    bool live = true;
+};
+
+// Longest first, so "<<=" is not read as "<<" "="
+const char *const OPERATORS[] = {"<<=", ">>=", "++", "--", "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=",
+                                 "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "^^"};
+const char *const OPERATOR_CHARS = "+-*/%<>=!&|^";
+
+bool isWordStart(char c) {
+    return isalpha((unsigned char) c) || c == '_';
+}
+
+bool isWordChar(char c) {
+    return isalnum((unsigned char) c) || c == '_';
+}
+
+/* Comments become a space, newlines inside block comments are kept so directives stay on their own lines */
+string stripComments(const string &source) {
+    string out;
+    out.reserve(source.size());
+    size_t n = source.size();
+    for (size_t i = 0; i < n; i++) {
+        if (source[i] == '/' && i + 1 < n && source[i + 1] == '/') {
+            while (i < n && source[i] != '\n') i++;
+            if (i < n) out += '\n';
+        } else if (source[i] == '/' && i + 1 < n && source[i + 1] == '*') {
+            for (i += 2; i < n && !(source[i] == '*' && i + 1 < n && source[i + 1] == '/'); i++) {
+                if (source[i] == '\n') out += '\n';
+            }
+            i++;
+            out += ' ';
+        } else {
+            out += source[i];
+        }
+    }
+    return out;
+}
+
+/* "#  define  A   1 " -> "#define A 1" */
+string normaliseDirective(const string &line) {
+    string out = "#";
+    bool space = false;
+    for (size_t i = line.find('#') + 1; i < line.size(); i++) {
+        if (isspace((unsigned char) line[i])) {
+            space = out.size() > 1;
+        } else {
+            if (space) out += ' ';
+            space = false;
+            out += line[i];
+        }
+    }
+    return out;
+}
+
+vector<Token> tokenize(const string &text) {
+    vector<Token> tokens;
+    size_t n = text.size();
+    bool lineStart = true;
+    size_t i = 0;
+    while (i < n) {
+        char c = text[i];
+        if (c == '\n') {
+            lineStart = true;
+            i++;
+        } else if (isspace((unsigned char) c)) {
+            i++;
+        } else if (c == '#' && lineStart) {
+            // A whole preprocessor line, including backslash continuations
+            string line;
+            while (i < n && text[i] != '\n') {
+                if (text[i] == '\\' && (text.compare(i + 1, 1, "\n") == 0 || text.compare(i + 1, 2, "\r\n") == 0)) {
+                    i = text.find('\n', i) + 1;
+                    line += ' ';
+                    continue;
+                }
+                line += text[i++];
+            }
+            tokens.push_back({Token::DIRECTIVE, normaliseDirective(line)});
+        } else if (isdigit((unsigned char) c) || (c == '.' && i + 1 < n && isdigit((unsigned char) text[i + 1]))) {
+            size_t start = i++;
+            bool hex = c == '0' && i < n && (text[i] == 'x' || text[i] == 'X');
+            while (i < n && (isWordChar(text[i]) || text[i] == '.' ||
+                             ((text[i] == '+' || text[i] == '-') && !hex && (text[i - 1] == 'e' || text[i - 1] == 'E')))) {
+                i++;
+            }
+            tokens.push_back({Token::NUMBER, text.substr(start, i - start)});
+            lineStart = false;
+        } else if (isWordStart(c)) {
+            size_t start = i;
+            while (i < n && isWordChar(text[i])) i++;
+            tokens.push_back({Token::WORD, text.substr(start, i - start)});
+            lineStart = false;
+        } else {
+            size_t length = 1;
+            for (const char *op : OPERATORS) {
+                if (text.compare(i, strlen(op), op) == 0) {
+                    length = strlen(op);
+                    break;
+                }
+            }
+            tokens.push_back({Token::SYMBOL, text.substr(i, length)});
+            i += length;
+            lineStart = false;
+        }
+    }
+    return tokens;
+}
+
+/* The tokens of a directive after the '#' */
+vector<Token> directiveTokens(const Token &directive) {
+    return tokenize(" " + directive.text.substr(1));
+}
+
+/* Split at top level ';' and at the closing brace of function bodies */
+vector<Item> parseItems(const vector<Token> &tokens) {
+    vector<Item> items;
+    Item current;
+    int braces = 0, parens = 0;
+    bool functionBody = false;
+    string previous;
+
+    for (const Token &t : tokens) {
+        if (t.kind == Token::DIRECTIVE) {
+            if (current.tokens.empty()) {
+                Item directive;
+                directive.kind = Item::DIRECTIVE;
+                directive.tokens.push_back(t);
+                items.push_back(directive);
+            } else {
+                current.tokens.push_back(t);
+                current.hasDirective = true;
+            }
+            continue;
+        }
+
+        current.tokens.push_back(t);
+        bool finished = false;
+        if (t.kind == Token::SYMBOL) {
+            if (t.text == "(") {
+                parens++;
+            } else if (t.text == ")") {
+                parens--;
+            } else if (t.text == "{") {
+                if (braces == 0) functionBody = previous == ")";
+                braces++;
+            } else if (t.text == "}") {
+                braces--;
+                finished = braces == 0 && functionBody;
+            } else if (t.text == ";") {
+                finished = braces == 0 && parens == 0;
+            }
+        }
+        previous = t.text;
+
+        if (finished) {
+            items.push_back(current);
+            current = Item();
+            functionBody = false;
+        }
+    }
+    // Unterminated trailing text is left for the driver to complain about
+    if (!current.tokens.empty()) items.push_back(current);
+    return items;
+}
+
+/* Work out what kind of declaration an item is, and the name it declares */
+void classify(Item &item) {
+    if (item.kind == Item::DIRECTIVE) return;
+
+    // Code tokens without directives and layout(...), which is parsed for the location only
+    vector<const Token *> code;
+    const vector<Token> &tokens = item.tokens;
+    for (size_t i = 0; i < tokens.size(); i++) {
+        if (tokens[i].kind == Token::DIRECTIVE) continue;
+        if (tokens[i].text == "layout" && i + 1 < tokens.size() && tokens[i + 1].text == "(") {
+            for (i += 2; i < tokens.size() && tokens[i].text != ")"; i++) {
+                if (tokens[i].text == "location" && i + 2 < tokens.size() && tokens[i + 1].text == "="
+                        && tokens[i + 2].kind == Token::NUMBER) {
+                    item.location = (int) strtol(tokens[i + 2].text.c_str(), nullptr, 0);
+                }
+            }
+            continue;
+        }
+        code.push_back(&tokens[i]);
+    }
+
+    size_t openParen = code.size(), openBrace = code.size(), assign = code.size();
+    bool comma = false, uniform = false, in = false, out = false;
+    int depth = 0;
+    for (size_t i = 0; i < code.size(); i++) {
+        const string &text = code[i]->text;
+        if (text == "(" && openParen == code.size()) openParen = i;
+        if (text == "{" && openBrace == code.size()) openBrace = i;
+        if (text == "=" && assign == code.size()) assign = i;
+        if (text == "(" || text == "[") depth++;
+        if (text == ")" || text == "]") depth--;
+        if (text == "," && depth == 0) comma = true;
+        if (openParen == code.size() && openBrace == code.size()) {
+            uniform |= text == "uniform";
+            in |= text == "in";
+            out |= text == "out";
+        }
+    }
+
+    // Definition or prototype: a name followed by '(' before any '=' or '{'
+    if (openParen > 0 && openParen < code.size() && openParen < assign && openParen < openBrace
+            && code[openParen - 1]->kind == Token::WORD) {
+        bool definition = openBrace < code.size() && code[openBrace - 1]->text == ")";
+        bool prototype = openBrace == code.size() && code.back()->text == ";" && code[code.size() - 2]->text == ")";
+        if (definition || prototype) {
+            item.kind = Item::FUNCTION;
+            item.name = code[openParen - 1]->text;
+        }
+        return;
+    }
+
+    // A single variable: the name is the last word before '[', '=' or ';'
+    if (openBrace < code.size() || comma || !(uniform || in || out)) return;
+    for (const Token *t : code) {
+        if (t->text == "[" || t->text == "=" || t->text == ";") break;
+        if (t->kind == Token::WORD) item.name = t->text;
+    }
+    item.kind = uniform ? Item::UNIFORM : in ? Item::INPUT : Item::OUTPUT;
+}
+
+void addReferences(const Item &item, set<string> &names) {
+    for (const Token &t : item.tokens) {
+        if (t.kind == Token::WORD) {
+            names.insert(t.text);
+        } else if (t.kind == Token::DIRECTIVE) {
+            // Macros can call functions or name uniforms too
+            for (const Token &word : directiveTokens(t)) {
+                if (word.kind == Token::WORD) names.insert(word.text);
+            }
+        }
+    }
+}
+
+/* Everything main() can reach, plus everything this pass cannot remove, is live */
+void markLive(vector<Item> &items) {
+    set<string> names;
+    for (Item &item : items) {
+        bool removable = (item.kind == Item::FUNCTION && item.name != "main")
+                || item.kind == Item::UNIFORM || item.kind == Item::INPUT;
+        item.live = !removable || item.hasDirective;
+        if (item.live) addReferences(item, names);
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (Item &item : items) {
+            if (!item.live && names.count(item.name)) {
+                item.live = true;
+                addReferences(item, names);
+                changed = true;
+            }
+        }
+    }
+}
+
+/* Substitute `#define NAME <number or bool>` into the code after it and drop the line, unless
+   another directive uses NAME (an unfolded #if, #undef or a redefinition) */
+size_t foldDefines(vector<Item> &items) {
+    struct Define {
+        size_t item;
+        Token value;
+        bool foldable;
+    };
+    map<string, Define> defines;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (items[i].kind != Item::DIRECTIVE) continue;
+        vector<Token> words = directiveTokens(items[i].tokens[0]);
+        if (words.size() == 3 && words[0].text == "define" && words[1].kind == Token::WORD
+                && (words[2].kind == Token::NUMBER || words[2].text == "true" || words[2].text == "false")) {
+            bool redefined = defines.count(words[1].text) > 0;
+            defines[words[1].text] = {i, words[2], !redefined};
+        }
+    }
+    if (defines.empty()) return 0;
+
+    for (size_t i = 0; i < items.size(); i++) {
+        for (const Token &t : items[i].tokens) {
+            if (t.kind != Token::DIRECTIVE) continue;
+            vector<Token> words = directiveTokens(t);
+            for (size_t w = 0; w < words.size(); w++) {
+                auto define = defines.find(words[w].text);
+                if (define == defines.end()) continue;
+                bool ownLine = items[i].kind == Item::DIRECTIVE && define->second.item == i && w == 1;
+                if (!ownLine) define->second.foldable = false;
+            }
+        }
+    }
+
+    size_t folded = 0;
+    for (auto &define : defines) {
+        if (!define.second.foldable) continue;
+        for (size_t i = define.second.item + 1; i < items.size(); i++) {
+            for (Token &t : items[i].tokens) {
+                if (t.kind == Token::WORD && t.text == define.first) t = define.second.value;
+            }
+        }
+        items[define.second.item].live = false;
+        folded++;
+    }
+    return folded;
+}
+
+bool needsSpace(char before, char after) {
+    return (isWordChar(before) && isWordChar(after))
+            || (strchr(OPERATOR_CHARS, before) && strchr(OPERATOR_CHARS, after));
+}
+
+/* One line per live item, tokens joined with only the spaces they need */
+string emit(const vector<Item> &items) {
+    string out;
+    for (const Item &item : items) {
+        if (!item.live) continue;
+
+        string line;
+        for (const Token &t : item.tokens) {
+            if (t.kind == Token::DIRECTIVE) {
+                if (!line.empty()) out += line + "\n";
+                line.clear();
+                // #line numbers no longer match anything once the text is minified
+                if (t.text.compare(0, 6, "#line ") != 0) out += t.text + "\n";
+                continue;
+            }
+            if (!line.empty() && needsSpace(line.back(), t.text[0])) line += ' ';
+            line += t.text;
+        }
+        if (!line.empty()) out += line + "\n";
+    }
+    return out;
+}
+
+vector<Item> parse(const string &source) {
+    vector<Item> items = parseItems(tokenize(stripComments(source)));
+    for (Item &item : items) {
+        classify(item);
+    }
+    return items;
+}
+
+}
+
+string ShaderOptimizer::optimize(const string &source, Stats *stats) {
+    vector<Item> items = parse(source);
+    size_t folded = foldDefines(items);
+
+    // Folding turned some items off, keep them off whatever markLive() decides
+    vector<Item> kept;
+    for (Item &item : items) {
+        if (item.live) kept.push_back(item);
+    }
+    markLive(kept);
+    string optimized = emit(kept);
+
+    if (stats) {
+        stats->bytesIn += source.size();
+        stats->bytesOut += optimized.size();
+        stats->definesFolded += folded;
+        for (const Item &item : kept) {
+            if (item.live) continue;
+            if (item.kind == Item::FUNCTION) {
+                stats->functionsRemoved++;
+            } else {
+                stats->declarationsRemoved++;
+            }
+        }
+    }
+    return optimized;
+}
+
+string ShaderOptimizer::pruneVaryings(const string &vertexSource, const string &fragmentSource, Stats *stats) {
+    // Inputs the fragment stage actually reads, matched by name or by location
+    vector<Item> fragment = parse(fragmentSource);
+    markLive(fragment);
+    set<string> names;
+    set<int> locations;
+    for (const Item &item : fragment) {
+        if (item.kind != Item::INPUT || !item.live) continue;
+        names.insert(item.name);
+        if (item.location >= 0) locations.insert(item.location);
+    }
+
+    static const set<string> OUTPUT_QUALIFIERS = {"out", "flat", "smooth", "noperspective", "centroid",
+                                                  "sample", "invariant"};
+    vector<Item> vertex = parse(vertexSource);
+    for (Item &item : vertex) {
+        if (item.kind != Item::OUTPUT || item.hasDirective) continue;
+        if (names.count(item.name) || (item.location >= 0 && locations.count(item.location))) continue;
+
+        vector<Token> global;
+        for (size_t i = 0; i < item.tokens.size(); i++) {
+            if (item.tokens[i].text == "layout") {
+                while (i < item.tokens.size() && item.tokens[i].text != ")") i++;
+            } else if (!OUTPUT_QUALIFIERS.count(item.tokens[i].text)) {
+                global.push_back(item.tokens[i]);
+            }
+        }
+        item.tokens = global;
+        item.kind = Item::OTHER;
+        if (stats) stats->varyingsDemoted++;
+    }
+    return emit(vertex);
+}
@@ -0,0 +1,35 @@
+/**
+shader_optimizer.h
+Source level GLSL optimisation ahead of glShaderSource: comments stripped, functions
+main() never reaches removed, unused uniforms and inputs removed, injected numeric
+defines substituted, and the rest minified to one top level declaration per line.
+Drivers fold constants and drop dead code themselves, but only after parsing all of
+it, and the front end cost grows with the text handed over.
+*/
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class ShaderOptimizer {
+public:
+    struct Stats {
+        size_t bytesIn = 0;
+        size_t bytesOut = 0;
+        size_t functionsRemoved = 0;
+        size_t declarationsRemoved = 0; // Unused uniforms and inputs
+        size_t definesFolded = 0;
+        size_t varyingsDemoted = 0;     // See pruneVaryings()
+    };
+
+    /* Optimise one stage. Conservative: anything the analysis does not understand (interface
+       blocks, structs, declarations mixed with preprocessor conditionals) is kept as it is.
+       Compile errors in the output refer to its own lines, one per top level declaration. */
+    static std::string optimize(const std::string &source, Stats *stats = nullptr);
+
+    /* Turn vertex outputs that the fragment stage never reads into plain globals, so the
+       vertex compiler can drop the code computing them. Only valid when the two stages are
+       linked together, not for separable programs. */
+    static std::string pruneVaryings(const std::string &vertexSource, const std::string &fragmentSource,
+                                     Stats *stats = nullptr);
+};
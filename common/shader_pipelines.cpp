@@ -0,0 +1,108 @@
+/**
+  shader_pipelines.cpp
+  Separable stage programs and the program pipeline objects combining them
+  */
+
+#include "shader_pipelines.h"
+#include "program_cache.h"
+#include "wrapper_glfw.h"
+
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+ShaderPipelines::ShaderPipelines(GLWrapper *glw) {
+    this->glw = glw;
+}
+
+ShaderPipelines::~ShaderPipelines() {
+    for (const auto &entry : pipelines) {
+        glDeleteProgramPipelines(1, &entry.second);
+    }
+    for (GLuint program : stagePrograms) {
+        glDeleteProgram(program);
+    }
+}
+
+GLuint ShaderPipelines::stage(GLenum type, const string &source) {
+    uint64_t key = ProgramCache::hash(&type, sizeof(type), ProgramCache::FNV_OFFSET);
+    key = ProgramCache::hash(source.data(), source.size(), key);
+
+    auto found = stages.find(key);
+    if (found != stages.end()) return found->second;
+
+    GLuint program = buildStage(type, source);
+    stages[key] = program;
+    stagePrograms.push_back(program);
+    return program;
+}
+
+GLuint ShaderPipelines::loadStage(GLenum type, const char *path, const ShaderDefines &defines) {
+    return stage(type, glw->readShader(path, defines));
+}
+
+/* Compile and link one stage as a separable program. Not glCreateShaderProgramv(), which links
+   straight away: the program cache needs the retrievable hint set before linking. */
+GLuint ShaderPipelines::buildStage(GLenum type, const string &stageSource) {
+    // Keyed on the text that is actually compiled, so toggling optimisation never picks up the other build
+    string source = glw->optimizeShader(stageSource);
+    ProgramCache *cache = glw->getProgramCache();
+    uint64_t cacheKey = 0;
+    if (cache) {
+        // Tagged so a stage never collides with a monolithic program built from the same text
+        cacheKey = cache->key({type == GL_VERTEX_SHADER ? "separable vertex" : "separable fragment", source});
+        GLuint cached = cache->load(cacheKey, true);
+        if (cached) return cached;
+    }
+
+    GLuint shader = glw->BuildShader(type, source);
+    GLuint program = glCreateProgram();
+    glProgramParameteri(program, GL_PROGRAM_SEPARABLE, GL_TRUE);
+    if (cache) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDetachShader(program, shader);
+    glDeleteShader(shader);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        GLint logLength = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+        vector<char> log((logLength > 1) ? logLength : 1);
+        glGetProgramInfoLog(program, logLength, NULL, &log[0]);
+        cerr << "Separable program link failure: " << &log[0] << endl;
+        glDeleteProgram(program);
+        throw runtime_error("Separable program link exception");
+    }
+
+    if (cache) cache->store(cacheKey, program);
+    return program;
+}
+
+GLuint ShaderPipelines::pipeline(GLuint vertexProgram, GLuint fragmentProgram) {
+    uint64_t key = ((uint64_t) vertexProgram << 32) | fragmentProgram;
+    auto found = pipelines.find(key);
+    if (found != pipelines.end()) return found->second;
+
+    GLuint pipeline;
+    glGenProgramPipelines(1, &pipeline);
+    glUseProgramStages(pipeline, GL_VERTEX_SHADER_BIT, vertexProgram);
+    glUseProgramStages(pipeline, GL_FRAGMENT_SHADER_BIT, fragmentProgram);
+
+    // Interface mismatches between the stages only show up here, not when either stage links
+    glValidateProgramPipeline(pipeline);
+    GLint valid = GL_FALSE;
+    glGetProgramPipelineiv(pipeline, GL_VALIDATE_STATUS, &valid);
+    if (valid == GL_FALSE) {
+        GLint logLength = 0;
+        glGetProgramPipelineiv(pipeline, GL_INFO_LOG_LENGTH, &logLength);
+        vector<char> log((logLength > 1) ? logLength : 1);
+        glGetProgramPipelineInfoLog(pipeline, logLength, NULL, &log[0]);
+        cerr << "Program pipeline validation: " << &log[0] << endl;
+    }
+
+    pipelines[key] = pipeline;
+    return pipeline;
+}
@@ -0,0 +1,60 @@
+/**
+shader_pipelines.h
+Separable programs (GL_ARB_separate_shader_objects, core in 4.1): each stage is
+compiled and linked once on its own, and any vertex/fragment pairing is a program
+pipeline object made on first use. N vertex and M fragment shaders cost N + M links
+instead of N * M. Update uniforms with glProgramUniform* (ShaderProgram does), since
+the pipeline rather than a bound program decides which stage program is in use.
+Make a pipeline current through GLState: useProgram(0), since a bound program takes
+precedence, then bindProgramPipeline().
+*/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "shader_preprocessor.h"
+
+class GLWrapper;
+
+class ShaderPipelines {
+public:
+    /* Stages are preprocessed by glw, cached by its program cache if enabled, and pipelines
+       belong to its context (pipeline objects are not shared between contexts) */
+    explicit ShaderPipelines(GLWrapper *glw);
+
+    /* Deletes the pipelines and the stage programs, the context must be current */
+    ~ShaderPipelines();
+
+    /* Separable program for one stage (GL_VERTEX_SHADER or GL_FRAGMENT_SHADER), built once per
+       distinct source. Throws runtime_error if it does not compile or link. */
+    GLuint stage(GLenum type, const std::string &source);
+
+    /* stage() for a shader file read through glw's preprocessor */
+    GLuint loadStage(GLenum type, const char *path, const ShaderDefines &defines = ShaderDefines());
+
+    /* The pipeline running these two stage programs, created the first time the pair is asked for.
+       Stage programs from a context in the same share group are fine. */
+    GLuint pipeline(GLuint vertexProgram, GLuint fragmentProgram);
+
+    /* Stage programs built, cache hits on the program cache included */
+    size_t getStagesBuilt() const {
+        return stagePrograms.size();
+    }
+
+    size_t getPipelinesCreated() const {
+        return pipelines.size();
+    }
+
+private:
+    GLWrapper *glw;
+    std::unordered_map<uint64_t, GLuint> stages;    // Hash of stage type and source
+    std::unordered_map<uint64_t, GLuint> pipelines; // Vertex program << 32 | fragment program
+    std::vector<GLuint> stagePrograms;
+
+    GLuint buildStage(GLenum type, const std::string &source);
+};
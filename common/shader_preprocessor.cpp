@@ -0,0 +1,474 @@
+/**
+  shader_preprocessor.cpp
+  #include expansion, define injection and conditional folding for GLSL.
+  Folding is conservative: a condition is only decided here if every macro it
+  mentions is known, everything else is left for the driver's preprocessor.
+  */
+
+#include "shader_preprocessor.h"
+#include "embedded_shaders.h"
+
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+static const int MAX_INCLUDE_DEPTH = 32;
+
+void ShaderPreprocessor::addIncludePath(const string &directory) {
+    includePaths.push_back(directory);
+}
+
+bool ShaderPreprocessor::exists(const string &path) const {
+    return (useEmbedded && findEmbeddedShader(path.c_str())) || filesystem::exists(path);
+}
+
+bool ShaderPreprocessor::readText(const string &path, string &text) const {
+    const EmbeddedShader *embedded = useEmbedded ? findEmbeddedShader(path.c_str()) : nullptr;
+    if (embedded) {
+        text.assign(embedded->source, embedded->length);
+        return true;
+    }
+
+    ifstream file(path, ios::in | ios::binary);
+    if (!file.is_open()) return false;
+    stringstream buffer;
+    buffer << file.rdbuf();
+    text = buffer.str();
+    return true;
+}
+
+string ShaderPreprocessor::processFile(const string &path, const ShaderDefines &defines) {
+    string source;
+    if (!readText(path, source)) {
+        throw runtime_error("Could not read shader " + path);
+    }
+    return processSource(source, path, defines);
+}
+
+/* The directive name of a preprocessor line ("include", "if", ...) and the text after it, or false */
+static bool parseDirective(const string &line, string &name, string &rest) {
+    size_t i = line.find_first_not_of(" \t");
+    if (i == string::npos || line[i] != '#') return false;
+    i = line.find_first_not_of(" \t", i + 1);
+    if (i == string::npos) return false;
+
+    size_t end = i;
+    while (end < line.size() && isalpha((unsigned char) line[end])) end++;
+    name = line.substr(i, end - i);
+
+    // Trailing // comments would confuse the expression parser
+    rest = line.substr(end);
+    size_t comment = rest.find("//");
+    if (comment != string::npos) rest.erase(comment);
+    return true;
+}
+
+string ShaderPreprocessor::resolveInclude(const string &name, const string &from) const {
+    string candidate = (filesystem::path(from).parent_path() / name).lexically_normal().string();
+    if (exists(candidate)) return candidate;
+
+    for (const string &directory : includePaths) {
+        candidate = (filesystem::path(directory) / name).lexically_normal().string();
+        if (exists(candidate)) return candidate;
+    }
+    return "";
+}
+
+/* Split into lines, replacing each #include with the included file between #line directives
+   so compile errors still point at the right file (source string number) and line */
+void ShaderPreprocessor::expandIncludes(const string &source, const string &path, int depth,
+                                        vector<string> &lines) {
+    int fileIndex = (int) files.size();
+    files.push_back(path);
+
+    istringstream in(source);
+    string line;
+    int lineNumber = 0;
+    while (getline(in, line)) {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+
+        string directive, rest;
+        if (parseDirective(line, directive, rest) && directive == "pragma" && rest.find("once") != string::npos) {
+            onceFiles.insert(path);
+            lines.push_back("");
+            continue;
+        }
+        if (!parseDirective(line, directive, rest) || directive != "include") {
+            lines.push_back(line);
+            continue;
+        }
+
+        size_t open = rest.find_first_of("\"<");
+        size_t close = open == string::npos ? string::npos : rest.find_first_of("\">", open + 1);
+        if (close == string::npos) {
+            throw runtime_error(path + ":" + to_string(lineNumber) + ": malformed #include");
+        }
+        string name = rest.substr(open + 1, close - open - 1);
+        string included = resolveInclude(name, path);
+        if (included.empty()) {
+            throw runtime_error(path + ":" + to_string(lineNumber) + ": cannot find include " + name);
+        }
+        if (depth >= MAX_INCLUDE_DEPTH) {
+            throw runtime_error(path + ":" + to_string(lineNumber) + ": includes nested too deeply (recursive?)");
+        }
+        if (onceFiles.count(included)) {
+            lines.push_back("");
+            continue;
+        }
+
+        string text;
+        readText(included, text);
+        lines.push_back("#line 1 " + to_string(files.size()));
+        expandIncludes(text, included, depth + 1, lines);
+        lines.push_back("#line " + to_string(lineNumber + 1) + " " + to_string(fileIndex));
+    }
+}
+
+/* Macro knowledge while folding: a name is defined with a value, known to be undefined,
+   or unknown. Names starting with GL_ or __ belong to the implementation (extensions,
+   __VERSION__) and are always unknown, as are names (re)defined inside a kept block. */
+struct MacroTable {
+    map<string, string> defined;
+    set<string> unknown;
+
+    bool isUnknown(const string &name) const {
+        return unknown.count(name) || name.compare(0, 3, "GL_") == 0 || name.compare(0, 2, "__") == 0;
+    }
+};
+
+/* Result of evaluating a #if expression, known = false if it depends on something we cannot see */
+struct Value {
+    bool known;
+    long long value;
+};
+
+/* Recursive descent evaluator for #if expressions (C preprocessor integer arithmetic) */
+class ConditionParser {
+public:
+    ConditionParser(const string &text, const MacroTable &macros, int depth = 0)
+            : text(text), pos(0), macros(macros), depth(depth) {
+    }
+
+    Value parse() {
+        Value v = parseBinary(0);
+        skipSpace();
+        if (pos != text.size()) v.known = false;
+        return v;
+    }
+
+private:
+    const string &text;
+    size_t pos;
+    const MacroTable &macros;
+    int depth;
+
+    void skipSpace() {
+        while (pos < text.size() && isspace((unsigned char) text[pos])) pos++;
+    }
+
+    string identifier() {
+        skipSpace();
+        size_t start = pos;
+        while (pos < text.size() && (isalnum((unsigned char) text[pos]) || text[pos] == '_')) pos++;
+        return text.substr(start, pos - start);
+    }
+
+    /* Binary operators by precedence, lowest first */
+    static int precedence(const string &op) {
+        static const char *levels[][4] = {
+            {"||"}, {"&&"}, {"|"}, {"^"}, {"&"}, {"==", "!="}, {"<", ">", "<=", ">="}, {"<<", ">>"},
+            {"+", "-"}, {"*", "/", "%"}
+        };
+        for (int level = 0; level < 10; level++) {
+            for (const char *candidate : levels[level]) {
+                if (candidate && op == candidate) return level;
+            }
+        }
+        return -1;
+    }
+
+    string peekOperator() {
+        skipSpace();
+        if (pos >= text.size()) return "";
+        string two = text.substr(pos, 2);
+        if (precedence(two) >= 0) return two;
+        string one = text.substr(pos, 1);
+        return precedence(one) >= 0 ? one : "";
+    }
+
+    Value parseBinary(int minLevel) {
+        Value left = parseUnary();
+        for (;;) {
+            string op = peekOperator();
+            int level = precedence(op);
+            if (op.empty() || level < minLevel) return left;
+            pos += op.size();
+
+            Value right = parseBinary(level + 1);
+            left = apply(op, left, right);
+        }
+    }
+
+    static Value apply(const string &op, Value a, Value b) {
+        // Short circuits that hold even if the other side is unknown
+        if (op == "&&" && ((a.known && !a.value) || (b.known && !b.value))) return {true, 0};
+        if (op == "||" && ((a.known && a.value) || (b.known && b.value))) return {true, 1};
+        if (!a.known || !b.known) return {false, 0};
+
+        long long x = a.value, y = b.value;
+        if (op == "||") return {true, x || y};
+        if (op == "&&") return {true, x && y};
+        if (op == "|") return {true, x | y};
+        if (op == "^") return {true, x ^ y};
+        if (op == "&") return {true, x & y};
+        if (op == "==") return {true, x == y};
+        if (op == "!=") return {true, x != y};
+        if (op == "<") return {true, x < y};
+        if (op == ">") return {true, x > y};
+        if (op == "<=") return {true, x <= y};
+        if (op == ">=") return {true, x >= y};
+        if (op == "<<") return {true, x << y};
+        if (op == ">>") return {true, x >> y};
+        if (op == "+") return {true, x + y};
+        if (op == "-") return {true, x - y};
+        if (op == "*") return {true, x * y};
+        if ((op == "/" || op == "%") && y == 0) return {false, 0};
+        if (op == "/") return {true, x / y};
+        return {true, x % y};
+    }
+
+    Value parseUnary() {
+        skipSpace();
+        if (pos >= text.size()) return {false, 0};
+
+        char c = text[pos];
+        if (c == '!' || c == '~' || c == '-' || c == '+') {
+            pos++;
+            Value v = parseUnary();
+            if (c == '!') v.value = !v.value;
+            if (c == '~') v.value = ~v.value;
+            if (c == '-') v.value = -v.value;
+            return v;
+        }
+        if (c == '(') {
+            pos++;
+            Value v = parseBinary(0);
+            skipSpace();
+            if (pos < text.size() && text[pos] == ')') {
+                pos++;
+            } else {
+                v.known = false;
+            }
+            return v;
+        }
+        if (isdigit((unsigned char) c)) {
+            size_t used = 0;
+            long long value = stoll(text.substr(pos), &used, 0);
+            pos += used;
+            while (pos < text.size() && (text[pos] == 'u' || text[pos] == 'U')) pos++;
+            return {true, value};
+        }
+
+        string name = identifier();
+        if (name.empty()) {
+            pos = text.size();
+            return {false, 0};
+        }
+
+        if (name == "defined") {
+            skipSpace();
+            bool paren = pos < text.size() && text[pos] == '(';
+            if (paren) pos++;
+            string macro = identifier();
+            if (paren) {
+                skipSpace();
+                if (pos < text.size() && text[pos] == ')') pos++;
+            }
+            if (macros.isUnknown(macro)) return {false, 0};
+            return {true, macros.defined.count(macro) ? 1 : 0};
+        }
+
+        // Macros expand to their value, undefined names are 0 as in C
+        if (macros.isUnknown(name) || depth > 16) return {false, 0};
+        auto it = macros.defined.find(name);
+        if (it == macros.defined.end()) return {true, 0};
+        if (it->second.empty()) return {false, 0};
+        return ConditionParser(it->second, macros, depth + 1).parse();
+    }
+};
+
+/* One open #if block while folding */
+struct Conditional {
+    bool kept;          // Left for the driver, the directives stay in the output
+    bool outerActive;   // The enclosing code is emitted
+    bool active;        // The current branch is emitted
+    bool taken;         // A branch of this block has already been chosen (folded blocks only)
+};
+
+static void splitDefine(const string &rest, string &name, string &value) {
+    size_t start = rest.find_first_not_of(" \t");
+    if (start == string::npos) {
+        name.clear();
+        return;
+    }
+    size_t end = start;
+    while (end < rest.size() && (isalnum((unsigned char) rest[end]) || rest[end] == '_')) end++;
+    name = rest.substr(start, end - start);
+
+    // Function-like macros cannot be evaluated here, give them no value so they count as unknown
+    if (end < rest.size() && rest[end] == '(') {
+        value.clear();
+        return;
+    }
+    size_t valueStart = rest.find_first_not_of(" \t", end);
+    value = valueStart == string::npos ? "1" : rest.substr(valueStart);
+    while (!value.empty() && isspace((unsigned char) value.back())) value.pop_back();
+}
+
+/* Does `line` mention `name` as a whole identifier */
+static bool mentions(const string &line, const string &name) {
+    size_t at = 0;
+    while ((at = line.find(name, at)) != string::npos) {
+        bool startOk = at == 0 || !(isalnum((unsigned char) line[at - 1]) || line[at - 1] == '_');
+        size_t end = at + name.size();
+        bool endOk = end >= line.size() || !(isalnum((unsigned char) line[end]) || line[end] == '_');
+        if (startOk && endOk) return true;
+        at = end;
+    }
+    return false;
+}
+
+string ShaderPreprocessor::processSource(const string &source, const string &path, const ShaderDefines &defines) {
+    files.clear();
+    onceFiles.clear();
+
+    vector<string> lines;
+    expandIncludes(source, path, 0, lines);
+
+    MacroTable macros;
+    for (const auto &define : defines) {
+        macros.defined[define.first] = define.second;
+    }
+
+    // Fold the conditionals, replacing dropped lines with blank ones so line numbers do not move
+    vector<Conditional> stack;
+    size_t versionLine = string::npos;
+    for (size_t i = 0; i < lines.size(); i++) {
+        string directive, rest;
+        bool active = stack.empty() || stack.back().active;
+        bool certain = true;
+        for (const Conditional &c : stack) {
+            if (c.kept) certain = false;
+        }
+
+        if (!parseDirective(lines[i], directive, rest)) {
+            if (!active) lines[i].clear();
+            continue;
+        }
+
+        if (directive == "if" || directive == "ifdef" || directive == "ifndef") {
+            Conditional c = {false, active, false, true};
+            if (active) {
+                Value v;
+                if (directive == "if") {
+                    v = ConditionParser(rest, macros).parse();
+                } else {
+                    string name, unused;
+                    splitDefine(rest, name, unused);
+                    v = {!macros.isUnknown(name), macros.defined.count(name) ? 1 : 0};
+                    if (directive == "ifndef") v.value = !v.value;
+                }
+
+                if (v.known) {
+                    c.active = v.value != 0;
+                    c.taken = c.active;
+                } else {
+                    c.kept = true;
+                    c.active = true;
+                }
+            }
+            stack.push_back(c);
+            if (!c.kept) lines[i].clear();
+        } else if ((directive == "elif" || directive == "else") && !stack.empty()) {
+            Conditional &c = stack.back();
+            if (c.kept) continue;
+
+            lines[i].clear();
+            if (!c.outerActive || c.taken) {
+                c.active = false;
+            } else if (directive == "else") {
+                c.active = c.taken = true;
+            } else {
+                Value v = ConditionParser(rest, macros).parse();
+                if (v.known) {
+                    c.active = c.taken = v.value != 0;
+                } else {
+                    // Every earlier branch was false and has been dropped, so the driver can take it from here
+                    lines[i] = "#if " + rest;
+                    c.kept = true;
+                    c.active = true;
+                }
+            }
+        } else if (directive == "endif" && !stack.empty()) {
+            if (!stack.back().kept) lines[i].clear();
+            stack.pop_back();
+        } else if (!active) {
+            lines[i].clear();
+        } else if (directive == "define" || directive == "undef") {
+            string name, value;
+            splitDefine(rest, name, value);
+            if (!certain) {
+                macros.unknown.insert(name);
+            } else if (directive == "define") {
+                macros.defined[name] = value;
+            } else {
+                macros.defined.erase(name);
+            }
+        } else if (directive == "version" && versionLine == string::npos) {
+            versionLine = i;
+        }
+    }
+
+    // Only inject the defines that the remaining code still refers to, so permutations that
+    // differ in features this shader does not use come out identical
+    vector<string> injected;
+    for (const auto &define : defines) {
+        for (size_t i = 0; i < lines.size(); i++) {
+            if (i != versionLine && mentions(lines[i], define.first)) {
+                injected.push_back("#define " + define.first + " " + define.second);
+                break;
+            }
+        }
+    }
+
+    string out;
+    for (size_t i = 0; i < lines.size(); i++) {
+        out += lines[i];
+        out += '\n';
+        if (i == versionLine && !injected.empty()) {
+            for (const string &define : injected) {
+                out += define + '\n';
+            }
+            out += "#line " + to_string(i + 2) + " 0\n";
+        }
+    }
+    return out;
+}
+
+string ShaderPreprocessor::normalise(const string &processed) {
+    istringstream in(processed);
+    string line, out;
+    while (getline(in, line)) {
+        string directive, rest;
+        if (line.find_first_not_of(" \t\r") == string::npos) continue;
+        if (parseDirective(line, directive, rest) && directive == "line") continue;
+        out += line;
+        out += '\n';
+    }
+    return out;
+}
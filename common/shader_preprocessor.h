@@ -0,0 +1,61 @@
+/**
+shader_preprocessor.h
+GLSL preprocessing ahead of the driver: #include resolution, injected #define sets
+and folding of #if/#ifdef blocks whose outcome is known from those defines, so
+each variant only contains the code it actually uses
+*/
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* Defines injected after the #version line, in order, e.g. {{"USE_FOG", "1"}, {"LIGHTS", "4"}} */
+typedef std::vector<std::pair<std::string, std::string>> ShaderDefines;
+
+class ShaderPreprocessor {
+public:
+    /* Directories searched for #include "file" after the including file's own directory */
+    void addIncludePath(const std::string &directory);
+
+    /* Whether shaders embedded in the executable are used before files on disk (the default).
+       Off for hot reload, which has to see the files being edited. */
+    void setUseEmbedded(bool enable) {
+        useEmbedded = enable;
+    }
+
+    /* Preprocess a shader file. Throws runtime_error for missing or recursive includes. */
+    std::string processFile(const std::string &path, const ShaderDefines &defines = ShaderDefines());
+
+    /* Preprocess source text, includes are resolved relative to `path` */
+    std::string processSource(const std::string &source, const std::string &path,
+                              const ShaderDefines &defines = ShaderDefines());
+
+    /* Files read by the last processFile() or processSource() call, the top-level file first */
+    const std::vector<std::string> &getFiles() const {
+        return files;
+    }
+
+    /* The text with blank lines and #line directives removed: two variants that normalise to
+       the same string compile to the same program */
+    static std::string normalise(const std::string &processed);
+
+private:
+    std::vector<std::string> includePaths;
+    bool useEmbedded = true;
+
+    /* Files expanded so far, the index is the GLSL source string number used in #line */
+    std::vector<std::string> files;
+    std::set<std::string> onceFiles;
+
+    void expandIncludes(const std::string &source, const std::string &path, int depth,
+                        std::vector<std::string> &lines);
+
+    std::string resolveInclude(const std::string &name, const std::string &from) const;
+
+    bool exists(const std::string &path) const;
+
+    bool readText(const std::string &path, std::string &text) const;
+};
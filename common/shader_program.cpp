@@ -0,0 +1,212 @@
+/**
+  shader_program.cpp
+  Program interface reflection. GL 4.3 contexts are queried through the program
+  interface API, older ones (macOS stops at 4.1) through glGetActiveUniform.
+  */
+
+#include "shader_program.h"
+#include "wrapper_glfw.h"
+
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+ShaderProgram::ShaderProgram() {
+    this->program = 0;
+    this->skippedUploads = 0;
+}
+
+bool ShaderProgram::load(GLWrapper *glw, const char *vertex_path, const char *fragment_path) {
+    GLuint linked = glw->LoadShader(vertex_path, fragment_path);
+
+    GLint status = GL_FALSE;
+    glGetProgramiv(linked, GL_LINK_STATUS, &status);
+    reflect(linked);
+    return status == GL_TRUE;
+}
+
+void ShaderProgram::destroy() {
+    glDeleteProgram(program);
+    reflect(0);
+}
+
+/* "lights[0]" is reported for arrays, but callers look arrays up by their plain name */
+static string baseName(const char *name) {
+    string s(name);
+    if (s.size() > 3 && s.compare(s.size() - 3, 3, "[0]") == 0) s.resize(s.size() - 3);
+    return s;
+}
+
+void ShaderProgram::reflect(GLuint program) {
+    this->program = program;
+    uniforms.clear();
+    blocks.clear();
+    attributes.clear();
+    uniformIndex.clear();
+
+    if (program) {
+        if (GLAD_GL_VERSION_4_3) {
+            reflectResources();
+        } else {
+            reflectLegacy();
+        }
+    }
+
+    for (size_t i = 0; i < uniforms.size(); i++) {
+        uniformIndex[uniforms[i].name] = (Uniform) i;
+    }
+    values.assign(uniforms.size() * MAX_COMPONENTS, 0);
+    valid.assign(uniforms.size(), false);
+}
+
+/* GL 4.3 program interface queries, one call returns every property of a resource */
+void ShaderProgram::reflectResources() {
+    GLint count = 0, maxName = 0;
+    glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+    glGetProgramInterfaceiv(program, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxName);
+    vector<char> name(maxName + 1);
+
+    const GLenum uniformProps[] = {GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE, GL_BLOCK_INDEX, GL_OFFSET};
+    for (GLint i = 0; i < count; i++) {
+        GLint props[5];
+        glGetProgramResourceiv(program, GL_UNIFORM, i, 5, uniformProps, 5, NULL, props);
+        glGetProgramResourceName(program, GL_UNIFORM, i, (GLsizei) name.size(), NULL, name.data());
+        uniforms.push_back({baseName(name.data()), props[0], (GLenum) props[1], props[2], props[3],
+                            props[3] >= 0 ? props[4] : -1});
+    }
+
+    glGetProgramInterfaceiv(program, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &count);
+    glGetProgramInterfaceiv(program, GL_UNIFORM_BLOCK, GL_MAX_NAME_LENGTH, &maxName);
+    name.resize(maxName + 1);
+    const GLenum blockProps[] = {GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE};
+    for (GLint i = 0; i < count; i++) {
+        GLint props[2];
+        glGetProgramResourceiv(program, GL_UNIFORM_BLOCK, i, 2, blockProps, 2, NULL, props);
+        glGetProgramResourceName(program, GL_UNIFORM_BLOCK, i, (GLsizei) name.size(), NULL, name.data());
+        blocks.push_back({name.data(), (GLuint) i, props[0], props[1]});
+    }
+
+    glGetProgramInterfaceiv(program, GL_PROGRAM_INPUT, GL_ACTIVE_RESOURCES, &count);
+    glGetProgramInterfaceiv(program, GL_PROGRAM_INPUT, GL_MAX_NAME_LENGTH, &maxName);
+    name.resize(maxName + 1);
+    const GLenum inputProps[] = {GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE};
+    for (GLint i = 0; i < count; i++) {
+        GLint props[3];
+        glGetProgramResourceiv(program, GL_PROGRAM_INPUT, i, 3, inputProps, 3, NULL, props);
+        glGetProgramResourceName(program, GL_PROGRAM_INPUT, i, (GLsizei) name.size(), NULL, name.data());
+        attributes.push_back({baseName(name.data()), props[0], (GLenum) props[1], props[2]});
+    }
+}
+
+/* GL 4.1: glGetActiveUniform and friends, plus a location query per name */
+void ShaderProgram::reflectLegacy() {
+    GLint count = 0, maxName = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxName);
+    vector<char> name(maxName + 1);
+
+    for (GLint i = 0; i < count; i++) {
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(program, (GLuint) i, (GLsizei) name.size(), NULL, &size, &type, name.data());
+
+        GLuint index = (GLuint) i;
+        GLint block, offset;
+        glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_BLOCK_INDEX, &block);
+        glGetActiveUniformsiv(program, 1, &index, GL_UNIFORM_OFFSET, &offset);
+        GLint location = block >= 0 ? -1 : glGetUniformLocation(program, name.data());
+        uniforms.push_back({baseName(name.data()), location, type, size, block, block >= 0 ? offset : -1});
+    }
+
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    for (GLint i = 0; i < count; i++) {
+        GLint length = 0, binding = 0, dataSize = 0;
+        glGetActiveUniformBlockiv(program, (GLuint) i, GL_UNIFORM_BLOCK_NAME_LENGTH, &length);
+        glGetActiveUniformBlockiv(program, (GLuint) i, GL_UNIFORM_BLOCK_BINDING, &binding);
+        glGetActiveUniformBlockiv(program, (GLuint) i, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+        name.resize(length + 1);
+        glGetActiveUniformBlockName(program, (GLuint) i, (GLsizei) name.size(), NULL, name.data());
+        blocks.push_back({name.data(), (GLuint) i, binding, dataSize});
+    }
+
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxName);
+    name.resize(maxName + 1);
+    for (GLint i = 0; i < count; i++) {
+        GLint size;
+        GLenum type;
+        glGetActiveAttrib(program, (GLuint) i, (GLsizei) name.size(), NULL, &size, &type, name.data());
+        attributes.push_back({baseName(name.data()), glGetAttribLocation(program, name.data()), type, size});
+    }
+}
+
+ShaderProgram::Uniform ShaderProgram::uniform(const char *name) const {
+    auto it = uniformIndex.find(name);
+    if (it == uniformIndex.end() || uniforms[it->second].location < 0) return INVALID;
+    return it->second;
+}
+
+GLint ShaderProgram::attribute(const char *name) const {
+    for (const AttributeInfo &a : attributes) {
+        if (a.name == name) return a.location;
+    }
+    return -1;
+}
+
+GLuint ShaderProgram::uniformBlock(const char *name) const {
+    for (const BlockInfo &b : blocks) {
+        if (b.name == name) return b.index;
+    }
+    return GL_INVALID_INDEX;
+}
+
+bool ShaderProgram::bindBlock(const char *name, GLuint binding) {
+    GLuint index = uniformBlock(name);
+    if (index == GL_INVALID_INDEX) return false;
+    glUniformBlockBinding(program, index, binding);
+    blocks[index].binding = (GLint) binding;
+    return true;
+}
+
+bool ShaderProgram::verifyBlock(const char *name, const vector<pair<string, size_t>> &offsets,
+                                size_t size) const {
+    GLuint index = uniformBlock(name);
+    if (index == GL_INVALID_INDEX) {
+        cerr << "Uniform block " << name << " is not active" << endl;
+        return false;
+    }
+
+    bool matches = true;
+    if ((size_t) blocks[index].dataSize != size) {
+        cerr << "Uniform block " << name << ": " << size << " bytes on the CPU, " << blocks[index].dataSize
+             << " in the program" << endl;
+        matches = false;
+    }
+
+    for (const auto &expected : offsets) {
+        auto it = uniformIndex.find(expected.first);
+        if (it == uniformIndex.end() || uniforms[it->second].block != (GLint) index) {
+            cerr << "Uniform block " << name << ": no active member " << expected.first << endl;
+            matches = false;
+        } else if ((size_t) uniforms[it->second].offset != expected.second) {
+            cerr << "Uniform block " << name << ": " << expected.first << " at offset " << expected.second
+                 << " on the CPU, " << uniforms[it->second].offset << " in the program" << endl;
+            matches = false;
+        }
+    }
+    return matches;
+}
+
+bool ShaderProgram::changed(Uniform u, const GLfloat *v, int count) {
+    if (u < 0) return false;
+
+    GLfloat *cached = &values[u * MAX_COMPONENTS];
+    if (valid[u] && memcmp(cached, v, count * sizeof(GLfloat)) == 0) {
+        skippedUploads++;
+        return false;
+    }
+    memcpy(cached, v, count * sizeof(GLfloat));
+    valid[u] = true;
+    return true;
+}
@@ -0,0 +1,155 @@
+/**
+shader_program.h
+A linked program with its active uniforms, uniform blocks and attributes enumerated
+once, so per-frame code sets uniforms through integer handles instead of looking up
+names. Setters remember the last value and skip the upload when it has not changed.
+*/
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <glad/glad.h>
+
+class GLWrapper;
+
+class ShaderProgram {
+public:
+    /* Index of an active uniform, INVALID for names that are not active (setters ignore it) */
+    typedef int Uniform;
+    static const Uniform INVALID = -1;
+
+    struct UniformInfo {
+        std::string name;   // Without a trailing [0] for arrays
+        GLint location;     // -1 for members of uniform blocks
+        GLenum type;        // e.g. GL_FLOAT_VEC4
+        GLint size;         // Array length, 1 otherwise
+        GLint block;        // Uniform block index, -1 for the default block
+        GLint offset;       // Byte offset within the block, -1 for the default block
+    };
+
+    struct BlockInfo {
+        std::string name;
+        GLuint index;
+        GLint binding;
+        GLint dataSize;
+    };
+
+    struct AttributeInfo {
+        std::string name;
+        GLint location;
+        GLenum type;
+        GLint size;
+    };
+
+    ShaderProgram();
+
+    /* LoadShader() the files and reflect the result, false if linking failed */
+    bool load(GLWrapper *glw, const char *vertex_path, const char *fragment_path);
+
+    /* Enumerate the interface of an already linked program, e.g. after a hot reload. Existing
+       handles are invalidated, look them up again. The program is not owned, see destroy(). */
+    void reflect(GLuint program);
+
+    /* glDeleteProgram, needs the context to be current */
+    void destroy();
+
+    GLuint id() const {
+        return program;
+    }
+
+    void use() const {
+        glUseProgram(program);
+    }
+
+    /* Handle lookups, meant for initialisation rather than the per-frame path */
+    Uniform uniform(const char *name) const;
+
+    GLint attribute(const char *name) const;
+
+    /* Uniform block index, or GL_INVALID_INDEX */
+    GLuint uniformBlock(const char *name) const;
+
+    /* Source block `name` from a binding point, e.g. one fed by UniformRing::bind(). GLSL 4.10 has
+       no layout(binding = N) for blocks, so this is set from C++. False if the block is not active. */
+    bool bindBlock(const char *name, GLuint binding);
+
+    /* Check a CPU layout of block `name` against the offsets and size the program reports,
+       printing every difference. See verifyLayout() in std_layout.h. */
+    bool verifyBlock(const char *name, const std::vector<std::pair<std::string, size_t>> &offsets,
+                     size_t size) const;
+
+    const std::vector<UniformInfo> &getUniforms() const {
+        return uniforms;
+    }
+
+    const std::vector<BlockInfo> &getBlocks() const {
+        return blocks;
+    }
+
+    const std::vector<AttributeInfo> &getAttributes() const {
+        return attributes;
+    }
+
+    /* Typed setters. They use glProgramUniform*, so the program does not need to be bound. */
+    void set(Uniform u, GLfloat x) {
+        GLfloat v[] = {x};
+        if (changed(u, v, 1)) glProgramUniform1f(program, uniforms[u].location, x);
+    }
+
+    void set(Uniform u, GLfloat x, GLfloat y) {
+        GLfloat v[] = {x, y};
+        if (changed(u, v, 2)) glProgramUniform2f(program, uniforms[u].location, x, y);
+    }
+
+    void set(Uniform u, GLfloat x, GLfloat y, GLfloat z) {
+        GLfloat v[] = {x, y, z};
+        if (changed(u, v, 3)) glProgramUniform3f(program, uniforms[u].location, x, y, z);
+    }
+
+    void set(Uniform u, GLfloat x, GLfloat y, GLfloat z, GLfloat w) {
+        GLfloat v[] = {x, y, z, w};
+        if (changed(u, v, 4)) glProgramUniform4f(program, uniforms[u].location, x, y, z, w);
+    }
+
+    void set(Uniform u, GLint x) {
+        // The int's own bits, a float conversion would make ints above 2^24 compare equal
+        GLfloat v[1];
+        memcpy(v, &x, sizeof(x));
+        if (changed(u, v, 1)) glProgramUniform1i(program, uniforms[u].location, x);
+    }
+
+    /* Column-major 4x4 matrix, e.g. glm::value_ptr(m) */
+    void setMatrix4(Uniform u, const GLfloat *m) {
+        if (changed(u, m, 16)) glProgramUniformMatrix4fv(program, uniforms[u].location, 1, GL_FALSE, m);
+    }
+
+    /* Uploads skipped because the value was already set */
+    size_t getSkippedUploads() const {
+        return skippedUploads;
+    }
+
+private:
+    static const int MAX_COMPONENTS = 16;
+
+    GLuint program;
+    std::vector<UniformInfo> uniforms;
+    std::vector<BlockInfo> blocks;
+    std::vector<AttributeInfo> attributes;
+    std::unordered_map<std::string, Uniform> uniformIndex;
+
+    // Last value sent for each uniform, MAX_COMPONENTS floats per uniform
+    std::vector<GLfloat> values;
+    std::vector<bool> valid;
+    size_t skippedUploads;
+
+    /* Compare with the cached value and update it, false if the upload can be skipped */
+    bool changed(Uniform u, const GLfloat *v, int count);
+
+    void reflectResources();
+
+    void reflectLegacy();
+};
@@ -0,0 +1,241 @@
+/**
+  shader_reloader.cpp
+  Watcher thread and program swap for shader hot reload
+  */
+
+#include "shader_reloader.h"
+#include "wrapper_glfw.h"
+
+#include <iostream>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/* How often the thread checks whether it should stop, and how often files are checked without inotify */
+static const int CHECK_INTERVAL_MS = 250;
+
+/* Editors often save in several steps (truncate, write, rename), wait for them to go quiet */
+static const int SETTLE_MS = 50;
+
+ShaderReloader::ShaderReloader(GLWrapper *glw) {
+    this->glw = glw;
+    this->pending = false;
+    this->running = true;
+    this->inotifyFD = -1;
+
+    // A 1x1 hidden context in the same share group, programs linked there are usable by glw
+    buildContext = new GLWrapper(1, 1, "Shader reload", true, glw);
+    // Rebuilds read the files being edited, never the copies compiled into the executable
+    buildContext->setUseEmbeddedShaders(false);
+    buildContext->setShaderOptimization(glw->getShaderOptimization());
+    buildContext->doneCurrent();
+    glw->makeCurrent();
+
+#ifdef __linux__
+    inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFD < 0) cerr << "Shader reload: inotify is not available, checking file times instead" << endl;
+#endif
+
+    thread = std::thread(&ShaderReloader::run, this);
+}
+
+ShaderReloader::~ShaderReloader() {
+    running = false;
+    thread.join();
+
+#ifdef __linux__
+    if (inotifyFD >= 0) close(inotifyFD);
+#endif
+
+    // Programs that were rebuilt but never swapped in
+    for (Rebuilt &r : rebuilt) {
+        glDeleteProgram(r.program);
+    }
+
+    delete buildContext;
+    glw->makeCurrent();
+}
+
+static filesystem::file_time_type modifiedTime(const string &path) {
+    error_code ignored;
+    return filesystem::last_write_time(path, ignored);
+}
+
+static vector<filesystem::file_time_type> modifiedTimes(const vector<string> &files) {
+    vector<filesystem::file_time_type> times;
+    for (const string &file : files) times.push_back(modifiedTime(file));
+    return times;
+}
+
+/* Preprocess both stages and return every file read, the stages themselves if that fails */
+static vector<string> shaderFiles(ShaderPreprocessor &preprocessor, const string &vertPath, const string &fragPath) {
+    vector<string> files;
+    for (const string &path : {vertPath, fragPath}) {
+        try {
+            preprocessor.processFile(path);
+            files.insert(files.end(), preprocessor.getFiles().begin(), preprocessor.getFiles().end());
+        } catch (exception &e) {
+            files.push_back(path);
+        }
+    }
+    return files;
+}
+
+void ShaderReloader::watchDirectories(const vector<string> &files) {
+#ifdef __linux__
+    // Watch the directories rather than the files, editors that save by renaming a new file
+    // over the old one would otherwise leave us watching a deleted inode. Adding a directory
+    // that is already watched does nothing.
+    if (inotifyFD < 0) return;
+    for (const string &path : files) {
+        string directory = filesystem::path(path).parent_path().string();
+        inotify_add_watch(inotifyFD, directory.empty() ? "." : directory.c_str(),
+                          IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    }
+#endif
+}
+
+void ShaderReloader::watch(const char *vertPath, const char *fragPath, GLuint *program,
+                           void (*onReload)(GLuint program)) {
+    lock_guard<std::mutex> lock(mutex);
+
+    // Include paths come from the owner; rebuilds read the files being edited, never embedded copies
+    preprocessor = glw->getShaderPreprocessor();
+    preprocessor.setUseEmbedded(false);
+
+    vector<string> files = shaderFiles(preprocessor, vertPath, fragPath);
+    Watch w = {vertPath, fragPath, program, onReload, false, files, modifiedTimes(files)};
+    watchDirectories(w.files);
+    watches.push_back(w);
+}
+
+void ShaderReloader::run() {
+    buildContext->makeCurrent();
+
+    while (running.load(memory_order_relaxed)) {
+        if (!waitForChanges(CHECK_INTERVAL_MS)) continue;
+        while (running.load(memory_order_relaxed) && waitForChanges(SETTLE_MS)) {
+        }
+        rebuild();
+    }
+
+    buildContext->doneCurrent();
+}
+
+/* Wait up to timeoutMs for a watched file to change, marking its watches dirty */
+bool ShaderReloader::waitForChanges(int timeoutMs) {
+    bool changed = false;
+
+#ifdef __linux__
+    if (inotifyFD >= 0) {
+        pollfd fd = {inotifyFD, POLLIN, 0};
+        if (::poll(&fd, 1, timeoutMs) <= 0) return false;
+
+        alignas(inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(inotifyFD, buffer, sizeof(buffer))) > 0) {
+            for (char *p = buffer; p < buffer + length; p += sizeof(inotify_event) + ((inotify_event *) p)->len) {
+                inotify_event *event = (inotify_event *) p;
+                if (event->len == 0) continue;
+
+                // Only the file name is reported, which is enough for the handful of files we watch
+                lock_guard<std::mutex> lock(mutex);
+                for (Watch &w : watches) {
+                    for (const string &file : w.files) {
+                        if (filesystem::path(file).filename() != event->name) continue;
+                        w.dirty = true;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        return changed;
+    }
+#endif
+
+    this_thread::sleep_for(chrono::milliseconds(timeoutMs));
+    lock_guard<std::mutex> lock(mutex);
+    for (Watch &w : watches) {
+        vector<filesystem::file_time_type> times = modifiedTimes(w.files);
+        if (times != w.times) {
+            w.times = times;
+            w.dirty = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/* Build every dirty program on the build context, the render thread is never held up */
+void ShaderReloader::rebuild() {
+    vector<pair<size_t, Watch>> dirty;
+    ShaderPreprocessor &buildPreprocessor = buildContext->getShaderPreprocessor();
+    {
+        lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < watches.size(); i++) {
+            if (!watches[i].dirty) continue;
+            watches[i].dirty = false;
+            dirty.push_back({i, watches[i]});
+        }
+        buildPreprocessor = preprocessor;
+    }
+
+    for (auto &d : dirty) {
+        const Watch &w = d.second;
+
+        // An edit can add or remove includes, so the files to watch are taken from this build
+        vector<string> files = shaderFiles(buildPreprocessor, w.vertPath, w.fragPath);
+        {
+            lock_guard<std::mutex> lock(mutex);
+            watches[d.first].files = files;
+            watches[d.first].times = modifiedTimes(files);
+            watchDirectories(files);
+        }
+
+        GLuint program;
+        try {
+            program = buildContext->BuildShaderProgram(buildContext->readShader(w.vertPath.c_str()),
+                                                       buildContext->readShader(w.fragPath.c_str()));
+        } catch (exception &e) {
+            cerr << "Shader reload: keeping the old program for " << w.vertPath << " + " << w.fragPath << endl;
+            continue;
+        }
+
+        // Make sure the program is completely built before another context can use it
+        glFinish();
+        cout << "Shader reload: rebuilt " << w.vertPath << " + " << w.fragPath << endl;
+
+        lock_guard<std::mutex> lock(mutex);
+        rebuilt.push_back({d.first, program});
+        pending.store(true, memory_order_release);
+    }
+
+    if (!dirty.empty() && pending.load()) glw->requestRedraw();
+}
+
+int ShaderReloader::update() {
+    if (!hasPending()) return 0;
+
+    vector<Rebuilt> ready;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        ready.swap(rebuilt);
+        pending.store(false, memory_order_relaxed);
+    }
+
+    for (Rebuilt &r : ready) {
+        Watch &w = watches[r.watch];
+
+        // Deleting a program that is still in use by queued draws is deferred by GL
+        GLuint old = *w.program;
+        *w.program = r.program;
+        if (old) glDeleteProgram(old);
+        if (w.onReload) w.onReload(r.program);
+    }
+    return (int) ready.size();
+}
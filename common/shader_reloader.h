@@ -0,0 +1,82 @@
+/**
+shader_reloader.h
+Shader hot reload: a watcher thread notices edits to shader files (inotify on Linux,
+modification times elsewhere), rebuilds the program on a hidden context that shares
+objects with the render context, and hands it over to be swapped in between frames.
+A program that fails to build is reported and the old one stays in use.
+*/
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "shader_preprocessor.h"
+
+class GLWrapper;
+
+class ShaderReloader {
+public:
+    /* Creates the build context, sharing with glw's, and leaves glw's context current */
+    explicit ShaderReloader(GLWrapper *glw);
+
+    ~ShaderReloader();
+
+    /* Rebuild *program from these files whenever one of them, or a file they #include, changes.
+       Rebuilds use the include paths of glw's preprocessor as they are when this is called.
+       onReload, if given, is called with the new program right after the swap, e.g. to look up
+       uniform locations again. */
+    void watch(const char *vertPath, const char *fragPath, GLuint *program, void (*onReload)(GLuint program));
+
+    /* True if a rebuilt program is waiting for update(), cheap enough to check every frame */
+    bool hasPending() const {
+        return pending.load(std::memory_order_acquire);
+    }
+
+    /* Swap in every finished program, call on the render thread between frames. Returns how many. */
+    int update();
+
+private:
+    struct Watch {
+        std::string vertPath;
+        std::string fragPath;
+        GLuint *program;
+        void (*onReload)(GLuint program);
+        bool dirty;
+        std::vector<std::string> files; // Both stages and everything they included in the last build
+        std::vector<std::filesystem::file_time_type> times;
+    };
+
+    struct Rebuilt {
+        size_t watch;
+        GLuint program;
+    };
+
+    GLWrapper *glw;
+    GLWrapper *buildContext;
+
+    std::mutex mutex; // Guards watches, rebuilt and preprocessor
+    std::vector<Watch> watches;
+    std::vector<Rebuilt> rebuilt;
+    std::atomic<bool> pending;
+
+    /* Copy of glw's preprocessor settings, handed to the build context for every rebuild */
+    ShaderPreprocessor preprocessor;
+
+    std::atomic<bool> running;
+    std::thread thread;
+    int inotifyFD;
+
+    void run();
+
+    bool waitForChanges(int timeoutMs);
+
+    void rebuild();
+
+    void watchDirectories(const std::vector<std::string> &files);
+};
@@ -0,0 +1,78 @@
+/**
+  shader_variants.cpp
+  Two level variant cache: request key -> program, preprocessed code -> program
+  */
+
+#include "shader_variants.h"
+#include "program_cache.h"
+#include "wrapper_glfw.h"
+
+using namespace std;
+
+ShaderVariants::ShaderVariants(GLWrapper *glw) {
+    this->glw = glw;
+    this->requested = 0;
+    this->deduplicated = 0;
+}
+
+ShaderVariants::~ShaderVariants() {
+    for (GLuint program : programs) {
+        glDeleteProgram(program);
+    }
+}
+
+static uint64_t hashString(const string &s, uint64_t h) {
+    // Length first, so "ab" + "c" and "a" + "bc" differ
+    uint64_t length = s.size();
+    h = ProgramCache::hash(&length, sizeof(length), h);
+    return ProgramCache::hash(s.data(), s.size(), h);
+}
+
+uint64_t ShaderVariants::hashFiles(const vector<string> &paths) const {
+    uint64_t h = ProgramCache::FNV_OFFSET;
+    for (const string &path : paths) {
+        h = hashString(glw->readFile(path.c_str()), hashString(path, h));
+    }
+    return h;
+}
+
+GLuint ShaderVariants::get(const char *vertex_path, const char *fragment_path, const ShaderDefines &defines) {
+    requested++;
+
+    // Defines are injected in the order given and a later one can test or redefine an earlier one,
+    // so order is part of the key. Orders that give the same code still share a program below.
+    string vertSource = glw->readFile(vertex_path);
+    string fragSource = glw->readFile(fragment_path);
+    uint64_t requestKey = hashString(fragSource, hashString(vertSource, ProgramCache::FNV_OFFSET));
+    for (const auto &define : defines) {
+        requestKey = hashString(define.second, hashString(define.first, requestKey));
+    }
+
+    // The top-level sources do not show changes to the files they include, so check those too
+    auto request = byRequest.find(requestKey);
+    if (request != byRequest.end() && hashFiles(request->second.includes) == request->second.includesKey) {
+        return request->second.program;
+    }
+
+    ShaderPreprocessor &preprocessor = glw->getShaderPreprocessor();
+    vector<string> includes;
+    string vertShaderStr = preprocessor.processSource(vertSource, vertex_path, defines);
+    includes.insert(includes.end(), preprocessor.getFiles().begin() + 1, preprocessor.getFiles().end());
+    string fragShaderStr = preprocessor.processSource(fragSource, fragment_path, defines);
+    includes.insert(includes.end(), preprocessor.getFiles().begin() + 1, preprocessor.getFiles().end());
+    uint64_t codeKey = hashString(ShaderPreprocessor::normalise(fragShaderStr),
+                                  hashString(ShaderPreprocessor::normalise(vertShaderStr), ProgramCache::FNV_OFFSET));
+
+    GLuint program;
+    auto code = byCode.find(codeKey);
+    if (code != byCode.end()) {
+        program = code->second;
+        deduplicated++;
+    } else {
+        program = glw->BuildShaderProgram(vertShaderStr, fragShaderStr);
+        programs.push_back(program);
+        byCode[codeKey] = program;
+    }
+    byRequest[requestKey] = {program, includes, hashFiles(includes)};
+    return program;
+}
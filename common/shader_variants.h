@@ -0,0 +1,62 @@
+/**
+shader_variants.h
+Cache of program permutations built from one pair of shader files with different
+define sets. Each request is keyed by a hash of the sources and the defines in order,
+and is only reused while the files it included are unchanged; after preprocessing,
+variants whose code comes out identical share one program.
+*/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "shader_preprocessor.h"
+
+class GLWrapper;
+
+class ShaderVariants {
+public:
+    /* Programs are built with glw (so its program cache applies) and belong to its context */
+    explicit ShaderVariants(GLWrapper *glw);
+
+    /* Deletes every program, the context must be current */
+    ~ShaderVariants();
+
+    /* The program for these files built with these defines. Throws runtime_error if it does not build. */
+    GLuint get(const char *vertex_path, const char *fragment_path, const ShaderDefines &defines);
+
+    /* Calls to get() */
+    size_t getRequested() const {
+        return requested;
+    }
+
+    /* Programs actually compiled, requested minus cache hits minus deduplicated variants */
+    size_t getCompiled() const {
+        return programs.size();
+    }
+
+    /* Variants that preprocessed to the same code as an existing program */
+    size_t getDeduplicated() const {
+        return deduplicated;
+    }
+
+private:
+    struct Request {
+        GLuint program;
+        std::vector<std::string> includes; // Files the sources included, not the sources themselves
+        uint64_t includesKey;              // Hash of their paths and contents
+    };
+
+    GLWrapper *glw;
+    std::unordered_map<uint64_t, Request> byRequest; // Hash of raw sources and defines
+    std::unordered_map<uint64_t, GLuint> byCode;    // Hash of the normalised preprocessed sources
+    std::vector<GLuint> programs;
+    size_t requested;
+    size_t deduplicated;
+
+    uint64_t hashFiles(const std::vector<std::string> &paths) const;
+};
@@ -0,0 +1,256 @@
+/**
+std_layout.h
+Uniform and shader storage block layouts (std140, std430) computed at compile time.
+A block is declared as a list of glm / scalar member types, e.g.
+    typedef Std140<glm::vec2, glm::vec3, float[4]> DrawData;
+Offsets, padding and array strides follow the GLSL rules, so DrawData::offset<1>() is 16
+and the object's bytes are the GPU image of the block: set<I>() writes a member in place,
+and the whole block can be copied into a buffer as it is. verifyLayout() checks the
+offsets against the ones a linked program reports.
+*/
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+
+#include <glm/glm.hpp>
+
+#include "shader_program.h"
+
+enum class LayoutRule {
+    STD140, // Uniform blocks: array elements and structs aligned to 16 bytes
+    STD430  // Shader storage blocks: packed to each type's own alignment
+};
+
+constexpr size_t layoutRoundUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/* alignment, size, write() and read() of one member type, specialised below */
+template<typename T, LayoutRule R>
+struct LayoutTraits;
+
+template<typename T>
+struct LayoutScalar {
+    static constexpr size_t alignment = sizeof(T);
+    static constexpr size_t size = sizeof(T);
+
+    static void write(unsigned char *dst, const T &value) {
+        memcpy(dst, &value, sizeof(T));
+    }
+
+    static void read(const unsigned char *src, T &value) {
+        memcpy(&value, src, sizeof(T));
+    }
+};
+
+template<LayoutRule R>
+struct LayoutTraits<float, R> : LayoutScalar<float> {
+};
+
+template<LayoutRule R>
+struct LayoutTraits<double, R> : LayoutScalar<double> {
+};
+
+template<LayoutRule R>
+struct LayoutTraits<int32_t, R> : LayoutScalar<int32_t> {
+};
+
+template<LayoutRule R>
+struct LayoutTraits<uint32_t, R> : LayoutScalar<uint32_t> {
+};
+
+/* GLSL bool is 4 bytes */
+template<LayoutRule R>
+struct LayoutTraits<bool, R> {
+    static constexpr size_t alignment = 4;
+    static constexpr size_t size = 4;
+
+    static void write(unsigned char *dst, const bool &value) {
+        uint32_t word = value ? 1 : 0;
+        memcpy(dst, &word, 4);
+    }
+
+    static void read(const unsigned char *src, bool &value) {
+        uint32_t word;
+        memcpy(&word, src, 4);
+        value = word != 0;
+    }
+};
+
+/* vec2 aligns to 2 components, vec3 and vec4 to 4 */
+template<glm::length_t L, typename T, glm::qualifier Q, LayoutRule R>
+struct LayoutTraits<glm::vec<L, T, Q>, R> {
+    static constexpr size_t alignment = (L == 2 ? 2 : 4) * sizeof(T);
+    static constexpr size_t size = L * sizeof(T);
+
+    static void write(unsigned char *dst, const glm::vec<L, T, Q> &value) {
+        memcpy(dst, &value[0], size);
+    }
+
+    static void read(const unsigned char *src, glm::vec<L, T, Q> &value) {
+        memcpy(&value[0], src, size);
+    }
+};
+
+/* Array elements: std140 rounds their alignment, and so the stride, up to a vec4 */
+template<typename T, LayoutRule R>
+struct LayoutElement {
+    static constexpr size_t alignment = R == LayoutRule::STD140
+            ? layoutRoundUp(LayoutTraits<T, R>::alignment, 16) : LayoutTraits<T, R>::alignment;
+    static constexpr size_t stride = layoutRoundUp(LayoutTraits<T, R>::size, alignment);
+};
+
+template<typename T, size_t N, LayoutRule R>
+struct LayoutTraits<T[N], R> {
+    static constexpr size_t alignment = LayoutElement<T, R>::alignment;
+    static constexpr size_t stride = LayoutElement<T, R>::stride;
+    static constexpr size_t size = N * stride;
+
+    static void write(unsigned char *dst, const T (&value)[N]) {
+        for (size_t i = 0; i < N; i++) LayoutTraits<T, R>::write(dst + i * stride, value[i]);
+    }
+
+    static void read(const unsigned char *src, T (&value)[N]) {
+        for (size_t i = 0; i < N; i++) LayoutTraits<T, R>::read(src + i * stride, value[i]);
+    }
+};
+
+/* Column-major matrices are laid out as an array of their column vectors */
+template<glm::length_t C, glm::length_t Rows, typename T, glm::qualifier Q, LayoutRule R>
+struct LayoutTraits<glm::mat<C, Rows, T, Q>, R> {
+    typedef glm::vec<Rows, T, Q> Column;
+    static constexpr size_t alignment = LayoutElement<Column, R>::alignment;
+    static constexpr size_t stride = LayoutElement<Column, R>::stride;
+    static constexpr size_t size = C * stride;
+
+    static void write(unsigned char *dst, const glm::mat<C, Rows, T, Q> &value) {
+        for (glm::length_t i = 0; i < C; i++) LayoutTraits<Column, R>::write(dst + i * stride, value[i]);
+    }
+
+    static void read(const unsigned char *src, glm::mat<C, Rows, T, Q> &value) {
+        for (glm::length_t i = 0; i < C; i++) LayoutTraits<Column, R>::read(src + i * stride, value[i]);
+    }
+};
+
+template<size_t I, typename First, typename... Rest>
+struct LayoutMemberType {
+    typedef typename LayoutMemberType<I - 1, Rest...>::type type;
+};
+
+template<typename First, typename... Rest>
+struct LayoutMemberType<0, First, Rest...> {
+    typedef First type;
+};
+
+/* A block, or a struct inside one, holding its members at their GPU offsets */
+template<LayoutRule R, typename... Members>
+class LayoutBlock {
+    static_assert(sizeof...(Members) > 0, "A block needs at least one member");
+
+public:
+    static constexpr size_t COUNT = sizeof...(Members);
+
+    template<size_t I>
+    using Member = typename LayoutMemberType<I, Members...>::type;
+
+private:
+    static constexpr std::array<size_t, COUNT> computeOffsets() {
+        const size_t alignments[] = {LayoutTraits<Members, R>::alignment...};
+        const size_t sizes[] = {LayoutTraits<Members, R>::size...};
+        std::array<size_t, COUNT> offsets{};
+        size_t offset = 0;
+        for (size_t i = 0; i < COUNT; i++) {
+            offset = layoutRoundUp(offset, alignments[i]);
+            offsets[i] = offset;
+            offset += sizes[i];
+        }
+        return offsets;
+    }
+
+    static constexpr size_t computeAlignment() {
+        const size_t alignments[] = {LayoutTraits<Members, R>::alignment...};
+        size_t largest = 1;
+        for (size_t a : alignments) largest = a > largest ? a : largest;
+        return R == LayoutRule::STD140 ? layoutRoundUp(largest, 16) : largest;
+    }
+
+    static constexpr std::array<size_t, COUNT> OFFSETS = computeOffsets();
+
+public:
+    /* A struct's alignment is its largest member's, rounded up to a vec4 in std140 */
+    static constexpr size_t ALIGNMENT = computeAlignment();
+
+    /* Size including the padding at the end, what GL reports as GL_UNIFORM_BLOCK_DATA_SIZE */
+    static constexpr size_t SIZE = layoutRoundUp(OFFSETS[COUNT - 1]
+            + LayoutTraits<Member<COUNT - 1>, R>::size, ALIGNMENT);
+
+    template<size_t I>
+    static constexpr size_t offset() {
+        static_assert(I < COUNT, "Member index out of range");
+        return OFFSETS[I];
+    }
+
+    static constexpr size_t size() {
+        return SIZE;
+    }
+
+    template<size_t I>
+    void set(const Member<I> &value) {
+        LayoutTraits<Member<I>, R>::write(bytes + OFFSETS[I], value);
+    }
+
+    template<size_t I>
+    void get(Member<I> &value) const {
+        LayoutTraits<Member<I>, R>::read(bytes + OFFSETS[I], value);
+    }
+
+    const void *data() const {
+        return bytes;
+    }
+
+    /* All offsets, in member order, e.g. for verifyLayout() */
+    static const std::array<size_t, COUNT> &offsets() {
+        return OFFSETS;
+    }
+
+private:
+    alignas(ALIGNMENT) unsigned char bytes[SIZE] = {};
+};
+
+template<typename... Members>
+using Std140 = LayoutBlock<LayoutRule::STD140, Members...>;
+
+template<typename... Members>
+using Std430 = LayoutBlock<LayoutRule::STD430, Members...>;
+
+/* A struct member of a block, declared with the block's own rule */
+template<LayoutRule R, typename... Members>
+struct LayoutTraits<LayoutBlock<R, Members...>, R> {
+    static constexpr size_t alignment = LayoutBlock<R, Members...>::ALIGNMENT;
+    static constexpr size_t size = LayoutBlock<R, Members...>::SIZE;
+
+    static void write(unsigned char *dst, const LayoutBlock<R, Members...> &value) {
+        memcpy(dst, value.data(), size);
+    }
+
+    static void read(const unsigned char *src, LayoutBlock<R, Members...> &value) {
+        memcpy(const_cast<void *>(value.data()), src, size);
+    }
+};
+
+/* Compare Block with uniform block `blockName` of a linked program, member by member. Names are
+   as the program reports them: "color", "lights" for an array, "material.albedo" for the first
+   member of a struct. Mismatches are printed; false if any offset or the size differs. */
+template<typename Block>
+bool verifyLayout(const ShaderProgram &program, const char *blockName, std::initializer_list<const char *> names) {
+    std::vector<std::pair<std::string, size_t>> expected;
+    size_t i = 0;
+    for (const char *name : names) {
+        if (i < Block::COUNT) expected.push_back({name, Block::offsets()[i++]});
+    }
+    return program.verifyBlock(blockName, expected, Block::SIZE);
+}
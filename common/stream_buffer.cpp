@@ -0,0 +1,106 @@
+/**
+  stream_buffer.cpp
+  Fenced segment ring over a persistently mapped or unsynchronized mapped buffer
+  */
+
+#include "stream_buffer.h"
+
+#include <cstring>
+
+using namespace std;
+
+// Allocations start on this boundary, enough for any vertex attribute or index type
+
+StreamBuffer::StreamBuffer(GLsizeiptr frameSize, int frames) {
+    this->frameSize = (frameSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (frames < 1) frames = 1;
+    if (frames > MAX_FRAMES) frames = MAX_FRAMES;
+    this->frames = frames;
+    this->segment = 0;
+    this->used = 0;
+    this->persistent = nullptr;
+    this->mapped = false;
+    this->waits = 0;
+    for (GLsync &fence : fences) fence = nullptr;
+
+    GLsizeiptr total = this->frameSize * this->frames;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    if (GLAD_GL_VERSION_4_4 && glBufferStorage) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, total, NULL, flags);
+        persistent = (char *) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, total, flags);
+    }
+    if (!persistent) {
+        // Storage from glBufferStorage is immutable, a failed mapping needs a new buffer
+        glDeleteBuffers(1, &buffer);
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, total, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+StreamBuffer::~StreamBuffer() {
+    for (GLsync &fence : fences) {
+        if (fence) glDeleteSync(fence);
+    }
+    if (persistent || mapped) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &buffer);
+}
+
+void StreamBuffer::beginFrame() {
+    segment = (segment + 1) % frames;
+    used = 0;
+
+    GLsync &fence = fences[segment];
+    if (!fence) return;
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        waits++;
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+void *StreamBuffer::map(GLsizeiptr size, GLintptr &offset) {
+    if (used + size > frameSize) return nullptr;
+
+    offset = segment * frameSize + used;
+    used = (used + size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (persistent) return persistent + offset;
+
+    // The fences already keep the GPU out of this range, so the driver need not synchronise
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    void *pointer = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size,
+                                     GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    mapped = pointer != nullptr;
+    return pointer;
+}
+
+void StreamBuffer::commit() {
+    // Coherent persistent writes are visible to commands issued after them
+    if (!mapped) return;
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    mapped = false;
+}
+
+GLintptr StreamBuffer::write(const void *data, GLsizeiptr size) {
+    GLintptr offset;
+    void *pointer = map(size, offset);
+    if (!pointer) return -1;
+    memcpy(pointer, data, size);
+    commit();
+    return offset;
+}
+
+void StreamBuffer::endFrame() {
+    if (fences[segment]) glDeleteSync(fences[segment]);
+    fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,71 @@
+/**
+stream_buffer.h
+Buffer for data rewritten every frame, e.g. animated vertices. The buffer holds one
+segment per frame in flight; each frame writes into the next segment while the GPU
+may still read the older ones, and a fence per segment makes sure a segment is only
+reused once the GPU is done with it. With GL 4.4 (glBufferStorage) the buffer
+is mapped once, persistently and coherently; otherwise every write maps its range
+unsynchronized, which the fences make safe as well.
+*/
+#pragma once
+
+#include <cstddef>
+
+#include <glad/glad.h>
+
+class StreamBuffer {
+public:
+    static const int MAX_FRAMES = 8;
+
+    /* Offsets handed out by map() and write() are multiples of this */
+    static const GLintptr ALIGNMENT = 16;
+
+    /* frameSize bytes per frame, `frames` frames in flight. Needs the context to be current. The
+       buffer can be bound as anything, e.g. GL_ARRAY_BUFFER; it is only ever bound to
+       GL_COPY_WRITE_BUFFER here, so a vertex array's element buffer binding is left alone. */
+    explicit StreamBuffer(GLsizeiptr frameSize, int frames = 3);
+
+    /* Deletes the buffer and fences, the context must be current */
+    ~StreamBuffer();
+
+    /* Move on to the next segment, waiting only if the GPU has not finished the frame that used it */
+    void beginFrame();
+
+    /* Room for `size` bytes in this frame's segment, at byte `offset` of getBuffer(). Fill it, then
+       call commit() before drawing from it. nullptr if the segment has no room left. */
+    void *map(GLsizeiptr size, GLintptr &offset);
+
+    /* Make the data written since map() visible to the GPU */
+    void commit();
+
+    /* map(), copy and commit() in one, returns the offset or -1 if the segment is full */
+    GLintptr write(const void *data, GLsizeiptr size);
+
+    /* Fence this frame's segment, call after the last draw that reads from it */
+    void endFrame();
+
+    GLuint getBuffer() const {
+        return buffer;
+    }
+
+    /* True if the buffer is persistently mapped (glBufferStorage) */
+    bool isPersistent() const {
+        return persistent != nullptr;
+    }
+
+    /* beginFrame() calls that had to wait for the GPU, a sign that more frames should be in flight */
+    size_t getWaits() const {
+        return waits;
+    }
+
+private:
+    GLuint buffer;
+    GLsizeiptr frameSize;
+    int frames;
+    int segment;        // Segment of the current frame
+    GLintptr used;      // Bytes of the segment handed out so far
+    char *persistent;   // Whole buffer, if persistently mapped
+    bool mapped;        // Fallback path: a range is mapped until commit()
+    GLsync fences[MAX_FRAMES];
+    size_t waits;
+};
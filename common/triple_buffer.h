@@ -0,0 +1,52 @@
+/**
+triple_buffer.h
+Lock-free single producer / single consumer triple buffer for handing state
+snapshots from an update thread to the render thread. The writer always has
+a slot to fill and the reader always has a complete snapshot, so neither side
+ever waits for the other.
+*/
+#pragma once
+
+#include <atomic>
+
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : back(0), middle(1), front(2) {
+    }
+
+    /* Initialise all three slots, call before either thread starts using the buffer */
+    void reset(const T &value) {
+        for (T &slot : slots) slot = value;
+        back = 0;
+        middle.store(1);
+        front = 2;
+    }
+
+    /* Writer: the slot to fill with the next snapshot */
+    T &write() {
+        return slots[back];
+    }
+
+    /* Writer: make the filled slot the latest snapshot and take the stale one back */
+    void publish() {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    /* Reader: the latest published snapshot, it stays valid until the next read() */
+    const T &read() {
+        if (middle.load(std::memory_order_relaxed) & FRESH) {
+            front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+        }
+        return slots[front];
+    }
+
+private:
+    static const unsigned char INDEX = 0x3;
+    static const unsigned char FRESH = 0x4;
+
+    T slots[3];
+    unsigned char back;                 // Owned by the writer
+    std::atomic<unsigned char> middle;  // Shared, FRESH set when it holds an unread snapshot
+    unsigned char front;                // Owned by the reader
+};
@@ -0,0 +1,64 @@
+/**
+  uniform_ring.cpp
+  Linear allocation in a CPU staging copy, wrapping to the start when full
+  */
+
+#include "uniform_ring.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+UniformRing::UniformRing(GLsizeiptr capacity) {
+    this->capacity = capacity;
+    this->head = 0;
+    this->flushed = 0;
+    this->uploads = 0;
+    this->bytesUploaded = 0;
+
+    // Offsets passed to glBindBufferRange must be multiples of this, commonly 16 to 256 bytes
+    alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment < 1) alignment = 256;
+
+    staging.resize(capacity);
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, capacity, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformRing::~UniformRing() {
+    glDeleteBuffers(1, &buffer);
+}
+
+UniformRing::Range UniformRing::push(const void *data, GLsizeiptr size) {
+    if (size > capacity) {
+        throw runtime_error("Uniform block larger than the uniform ring");
+    }
+
+    GLintptr offset = (head + alignment - 1) / alignment * alignment;
+    if (offset + size > capacity) {
+        // Upload the tail before its bytes can be overwritten, then start again at the front
+        flush();
+        offset = 0;
+        flushed = 0;
+    }
+
+    memcpy(&staging[offset], data, size);
+    head = offset + size;
+    return {offset, size};
+}
+
+void UniformRing::flush() {
+    if (head <= flushed) return;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, flushed, head - flushed, &staging[flushed]);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    uploads++;
+    bytesUploaded += head - flushed;
+    flushed = head;
+}
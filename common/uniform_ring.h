@@ -0,0 +1,75 @@
+/**
+uniform_ring.h
+One large uniform buffer used as a ring: per-frame and per-draw blocks are packed into
+it on the CPU, uploaded with a single glBufferSubData per flush() and bound per draw
+with glBindBufferRange, instead of a glUniform* call per value.
+*/
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <glad/glad.h>
+
+class UniformRing {
+public:
+    /* A block inside the ring, for bind() */
+    struct Range {
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    /* Creates the buffer on the current context. Bindings are per context, so each context
+       should have its own ring (see GLWrapper::getUniformRing()). */
+    explicit UniformRing(GLsizeiptr capacity = 1 << 20);
+
+    /* Deletes the buffer, the context must be current */
+    ~UniformRing();
+
+    /* Copy a block into the ring at the next offset the driver accepts for a binding
+       (GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT). The GPU sees it after the next flush(). Throws
+       runtime_error if the block is larger than the ring. */
+    Range push(const void *data, GLsizeiptr size);
+
+    template<typename T>
+    Range push(const T &block) {
+        return push(&block, sizeof(T));
+    }
+
+    /* Upload everything pushed since the last flush, call it before drawing with those blocks.
+       Earlier draws keep the data they were issued with even when the ring wraps, because
+       glBufferSubData is ordered with the draw calls. */
+    void flush();
+
+    /* Make a pushed block the contents of uniform block binding point `binding` */
+    void bind(GLuint binding, const Range &range) const {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, range.offset, range.size);
+    }
+
+    GLuint getBuffer() const {
+        return buffer;
+    }
+
+    GLint getAlignment() const {
+        return alignment;
+    }
+
+    /* glBufferSubData calls and bytes uploaded so far */
+    size_t getUploads() const {
+        return uploads;
+    }
+
+    size_t getBytesUploaded() const {
+        return bytesUploaded;
+    }
+
+private:
+    GLuint buffer;
+    GLsizeiptr capacity;
+    GLint alignment;
+    std::vector<char> staging; // CPU copy of the ring, uploaded a range at a time
+    GLintptr head;             // Next free byte
+    GLintptr flushed;          // Start of the bytes pushed but not uploaded yet
+    size_t uploads;
+    size_t bytesUploaded;
+};
@@ -0,0 +1,231 @@
+/**
+vertex_layout.h
+Vertex formats declared as a list of attribute formats, with the stride and offsets
+computed at compile time, e.g.
+    typedef VertexLayout<AttribHalf<4>, AttribUNorm8<4>, AttribSNorm10<>> Layout;
+is a half-float position, a normalised byte colour and a 10:10:10:2 normal in 16 bytes
+per vertex, where three float4 attributes take 48. Attribute I is shader location I.
+Layout::Vertex holds one interleaved vertex (an array of them is the AoS stream) and
+Layout::Streams one tightly packed array per attribute (SoA). interleaved() / planar()
+make the glVertexAttribPointer calls for the buffer bound to GL_ARRAY_BUFFER.
+*/
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+/* Attributes start on a 4 byte boundary, as some drivers require */
+constexpr size_t vertexRoundUp(size_t value) {
+    return (value + 3) / 4 * 4;
+}
+
+/* N floats, 4N bytes */
+template<int N>
+struct AttribFloat {
+    typedef glm::vec<N, float> Value;
+    static constexpr GLint COMPONENTS = N;
+    static constexpr GLenum TYPE = GL_FLOAT;
+    static constexpr GLboolean NORMALIZED = GL_FALSE;
+    static constexpr size_t SIZE = 4 * N;
+
+    static void write(unsigned char *dst, const Value &value) {
+        memcpy(dst, &value[0], SIZE);
+    }
+};
+
+/* N half floats, 2N bytes: ~3 significant digits, plenty for positions in a unit sized model */
+template<int N>
+struct AttribHalf {
+    typedef glm::vec<N, float> Value;
+    static constexpr GLint COMPONENTS = N;
+    static constexpr GLenum TYPE = GL_HALF_FLOAT;
+    static constexpr GLboolean NORMALIZED = GL_FALSE;
+    static constexpr size_t SIZE = 2 * N;
+
+    static void write(unsigned char *dst, const Value &value) {
+        for (int i = 0; i < N; i++) {
+            uint16_t half = glm::packHalf1x16(value[i]);
+            memcpy(dst + 2 * i, &half, 2);
+        }
+    }
+};
+
+/* N unsigned bytes read as 0..1, N bytes: colours */
+template<int N>
+struct AttribUNorm8 {
+    typedef glm::vec<N, float> Value;
+    static constexpr GLint COMPONENTS = N;
+    static constexpr GLenum TYPE = GL_UNSIGNED_BYTE;
+    static constexpr GLboolean NORMALIZED = GL_TRUE;
+    static constexpr size_t SIZE = N;
+
+    static void write(unsigned char *dst, const Value &value) {
+        for (int i = 0; i < N; i++) {
+            dst[i] = (unsigned char) std::lround(glm::clamp(value[i], 0.0f, 1.0f) * 255.0f);
+        }
+    }
+};
+
+/* xyz as signed 10 bit and w as signed 2 bit values read as -1..1 (GL_INT_2_10_10_10_REV),
+   4 bytes: normals and tangents, with w for the handedness.
+   The conversion depends on the implementation: GL 4.2 and later read c / (2^(b-1) - 1), GL 4.1
+   (e.g. macOS) reads (2c + 1) / (2^b - 1). On 4.1 xyz are off by up to half a step and zero is not
+   exact, and w can only be -1 or 1, so with N = 3 declare the shader input as vec3. */
+template<int N = 3>
+struct AttribSNorm10 {
+    static_assert(N == 3 || N == 4, "10:10:10:2 attributes have 3 or 4 components");
+    typedef glm::vec<N, float> Value;
+    static constexpr GLint COMPONENTS = 4;
+    static constexpr GLenum TYPE = GL_INT_2_10_10_10_REV;
+    static constexpr GLboolean NORMALIZED = GL_TRUE;
+    static constexpr size_t SIZE = 4;
+
+    static void write(unsigned char *dst, const Value &value) {
+        uint32_t packed = 0;
+        for (int i = 0; i < 3; i++) {
+            long component = std::lround(glm::clamp(value[i], -1.0f, 1.0f) * 511.0f);
+            packed |= (uint32_t) (component & 0x3ff) << (10 * i);
+        }
+        // -1 is stored as -2, which both conversions read as -1. With N = 3 w is 0, which only 4.2 reads as 0.
+        long w = N == 4 ? std::lround(glm::clamp(value[N - 1], -1.0f, 1.0f)) : 0;
+        if (w < 0) w = -2;
+        packed |= (uint32_t) (w & 0x3) << 30;
+        memcpy(dst, &packed, 4);
+    }
+};
+
+template<size_t I, typename First, typename... Rest>
+struct VertexAttribType {
+    typedef typename VertexAttribType<I - 1, Rest...>::type type;
+};
+
+template<typename First, typename... Rest>
+struct VertexAttribType<0, First, Rest...> {
+    typedef First type;
+};
+
+template<typename... Attribs>
+class VertexLayout {
+    static_assert(sizeof...(Attribs) > 0, "A vertex needs at least one attribute");
+
+public:
+    static constexpr size_t COUNT = sizeof...(Attribs);
+
+    template<size_t I>
+    using Attrib = typename VertexAttribType<I, Attribs...>::type;
+
+private:
+    static constexpr std::array<size_t, COUNT> computeOffsets() {
+        const size_t sizes[] = {Attribs::SIZE...};
+        std::array<size_t, COUNT> offsets{};
+        size_t offset = 0;
+        for (size_t i = 0; i < COUNT; i++) {
+            offsets[i] = offset;
+            offset = vertexRoundUp(offset + sizes[i]);
+        }
+        return offsets;
+    }
+
+    static constexpr std::array<size_t, COUNT> OFFSETS = computeOffsets();
+
+public:
+    /* Bytes per interleaved vertex */
+    static constexpr size_t STRIDE = vertexRoundUp(OFFSETS[COUNT - 1] + Attrib<COUNT - 1>::SIZE);
+
+    template<size_t I>
+    static constexpr size_t offset() {
+        static_assert(I < COUNT, "Attribute index out of range");
+        return OFFSETS[I];
+    }
+
+    /* Start of attribute I's array in a planar block of `count` vertices */
+    static size_t planarOffset(size_t attrib, size_t count) {
+        const size_t sizes[] = {Attribs::SIZE...};
+        size_t offset = 0;
+        for (size_t i = 0; i < attrib; i++) offset = vertexRoundUp(offset + sizes[i] * count);
+        return offset;
+    }
+
+    /* Bytes of a planar block of `count` vertices */
+    static size_t planarSize(size_t count) {
+        return vertexRoundUp(planarOffset(COUNT - 1, count) + Attrib<COUNT - 1>::SIZE * count);
+    }
+
+    /* One interleaved vertex, exactly STRIDE bytes, so an array of them can be uploaded as it is */
+    class Vertex {
+    public:
+        template<size_t I>
+        void set(const typename Attrib<I>::Value &value) {
+            Attrib<I>::write(bytes + OFFSETS[I], value);
+        }
+
+        const void *data() const {
+            return bytes;
+        }
+
+    private:
+        unsigned char bytes[STRIDE] = {};
+    };
+
+    /* `count` vertices as one tightly packed array per attribute */
+    class Streams {
+    public:
+        explicit Streams(size_t count) : count(count), bytes(planarSize(count)) {
+        }
+
+        template<size_t I>
+        void set(size_t vertex, const typename Attrib<I>::Value &value) {
+            Attrib<I>::write(&bytes[planarOffset(I, count) + vertex * Attrib<I>::SIZE], value);
+        }
+
+        const void *data() const {
+            return bytes.data();
+        }
+
+        size_t size() const {
+            return bytes.size();
+        }
+
+    private:
+        size_t count;
+        std::vector<unsigned char> bytes;
+    };
+
+    /* Point and enable attributes 0..COUNT-1 at interleaved vertices starting `base` bytes into the
+       GL_ARRAY_BUFFER binding */
+    static void interleaved(GLintptr base = 0) {
+        const GLint components[] = {Attribs::COMPONENTS...};
+        const GLenum types[] = {Attribs::TYPE...};
+        const GLboolean normalized[] = {Attribs::NORMALIZED...};
+        for (size_t i = 0; i < COUNT; i++) {
+            glVertexAttribPointer((GLuint) i, components[i], types[i], normalized[i], (GLsizei) STRIDE,
+                                  (void *) (base + OFFSETS[i]));
+            glEnableVertexAttribArray((GLuint) i);
+        }
+    }
+
+    /* The same for a planar block of `count` vertices (Streams) starting `base` bytes into the buffer */
+    static void planar(size_t count, GLintptr base = 0) {
+        const GLint components[] = {Attribs::COMPONENTS...};
+        const GLenum types[] = {Attribs::TYPE...};
+        const GLboolean normalized[] = {Attribs::NORMALIZED...};
+        for (size_t i = 0; i < COUNT; i++) {
+            glVertexAttribPointer((GLuint) i, components[i], types[i], normalized[i], 0,
+                                  (void *) (base + planarOffset(i, count)));
+            glEnableVertexAttribArray((GLuint) i);
+        }
+    }
+
+    /* Disable the attribute arrays interleaved() or planar() enabled */
+    static void disable() {
+        for (size_t i = 0; i < COUNT; i++) glDisableVertexAttribArray((GLuint) i);
+    }
+};
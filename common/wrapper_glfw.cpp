@@ -6,23 +6,110 @@
   */
 
 #include "wrapper_glfw.h"
+#include "shader_reloader.h"
+#include "shader_variants.h"
+#include "shader_pipelines.h"
+#include "uniform_ring.h"
+#include "buffer_heap.h"
+#include "embedded_shaders.h"
+
+#ifdef GLWRAPPER_GL_MANIFEST
+#include "glad_manifest.h"
+#endif
+
+/* Surfaceless EGL is used for headless contexts where it is available (Mesa on Linux),
+   otherwise headless mode falls back to a hidden GLFW window */
+#ifdef GLWRAPPER_USE_EGL
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 /* Include some standard headers */
 
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <cstring>
+#include <algorithm>
 
 using namespace std;
 
+/* Longest time the render-on-demand loop sleeps before re-checking for work, seconds */
+static const double IDLE_WAIT = 0.5;
+
+int GLWrapper::liveInstances = 0;
+
 /* Constructor for wrapper object */
-GLWrapper::GLWrapper(int width, int height, const char *title) {
+GLWrapper::GLWrapper(int width, int height, const char *title, bool headless, GLWrapper *share) {
+    liveInstances++;
+
     this->width = width;
     this->height = height;
     this->title = title;
     this->fps = 60;
+    this->swapInterval = 1;
+    this->pendingInputTime = 0;
+    this->lastLatency = -1;
     this->running = true;
     this->renderer = nullptr;
+    this->interpolatedRenderer = nullptr;
+    this->viewRenderer = nullptr;
+    this->updater = nullptr;
+    this->updateRequested = false;
+    this->threadedUpdate = false;
+    this->updateThreadRunning = false;
+    this->renderOnDemand = false;
+    this->redrawRequested = true;
+    this->idleFPS = 5;
+    this->focused = true;
+    this->iconified = false;
+    this->drawThisFrame = false;
+    this->droppedInput = 0;
+    this->deterministic = false;
+    this->nextScriptedInput = 0;
+    this->warmupFrames = 0;
+    this->createdAt = FramePacer::Clock::now();
+    this->userKeyCallback = nullptr;
+    this->userReshapeCallback = nullptr;
+    this->userData = nullptr;
+    this->window = nullptr;
+    this->headless = headless;
+    this->frameLimit = 0;
+    this->offscreenFBO = 0;
+    this->offscreenColour = 0;
+    this->offscreenDepth = 0;
+    this->eglDisplay = nullptr;
+    this->eglContext = nullptr;
+    this->eglSurface = nullptr;
+    this->frameStats = nullptr;
+    this->statsCSVPath = nullptr;
+    this->statsJSONPath = nullptr;
+    this->programCache = nullptr;
+    this->buildQueue = nullptr;
+    this->shaderReloader = nullptr;
+    this->shaderVariants = nullptr;
+    this->shaderPipelines = nullptr;
+    this->uniformRing = nullptr;
+    this->bufferHeap = nullptr;
+    this->useEmbeddedShaders = true;
+    this->optimizeShaders = false;
+
+    // Nothing is presented in headless mode, so there is no reason to hold frames back
+    if (headless) this->fps = 0;
+    pacer.setTargetFPS(fps);
+
+#ifdef GLWRAPPER_USE_EGL
+    if (headless && (!share || share->eglContext)) {
+        if (!createHeadlessContext(share)) {
+            cout << "Could not create a headless EGL context." << endl;
+            exit(EXIT_FAILURE);
+        }
+        createOffscreenTarget();
+        glEnable(GL_MULTISAMPLE);
+        return;
+    }
+#endif
 
     /* Initialise GLFW and exit if it fails */
     if (!glfwInit()) {
@@ -50,7 +137,11 @@ GLWrapper::GLWrapper(int width, int height, const char *title) {
     glfwOpenWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
 #endif
 
-    window = glfwCreateWindow(width, height, title, 0, 0);
+    // Headless without EGL: keep the window hidden and draw into our own framebuffer.
+    // Hints outlive this call, so set it both ways for the next window created.
+    glfwWindowHint(GLFW_VISIBLE, headless ? GLFW_FALSE : GLFW_TRUE);
+
+    window = glfwCreateWindow(width, height, title, 0, share ? share->window : 0);
     if (!window) {
         cout << "Could not open GLFW window." << endl;
         glfwTerminate();
@@ -62,8 +153,9 @@ GLWrapper::GLWrapper(int width, int height, const char *title) {
 
     /* Initialise GLLoad library. You must have obtained a current OpenGL */
     // glad: load all OpenGL function pointers
+    // A shared context comes from the same driver, so the pointers loaded for the first one are still valid
     // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+    if (!share && !loadGL((GLADloadproc) glfwGetProcAddress)) {
         std::cout << "Failed to initialize GLAD - exiting" << std::endl;
         glfwTerminate();
         return;
@@ -74,13 +166,205 @@ GLWrapper::GLWrapper(int width, int height, const char *title) {
 
     glfwSetInputMode(window, GLFW_STICKY_KEYS, true);
 
+    /* Window state callbacks used by render-on-demand, they find this object through the user pointer */
+    glfwSetWindowUserPointer(window, this);
+    glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+    glfwSetWindowFocusCallback(window, windowFocusCallback);
+    glfwSetWindowIconifyCallback(window, windowIconifyCallback);
+    glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+
+    /* Input callbacks that timestamp and queue every event for pollInput() */
+    glfwSetKeyCallback(window, keyCallback);
+    glfwSetMouseButtonCallback(window, mouseButtonCallback);
+    glfwSetCursorPosCallback(window, cursorPosCallback);
+    glfwSetScrollCallback(window, scrollCallback);
+
+    if (headless) createOffscreenTarget();
+
     glEnable(GL_MULTISAMPLE);
 }
 
 
-/* Terminate GLFW on destruction of the wrapper object */
+/* Destroy the window on destruction of the wrapper object, GLFW is terminated with the last one */
 GLWrapper::~GLWrapper() {
-    glfwTerminate();
+    stopUpdateThread();
+    delete shaderReloader;
+    if (shaderVariants || shaderPipelines || uniformRing || bufferHeap) {
+        makeCurrent();
+        delete shaderVariants;
+        delete shaderPipelines;
+        delete uniformRing;
+        delete bufferHeap;
+    }
+    releaseContext();
+    delete frameStats;
+    delete buildQueue;
+    delete programCache;
+}
+
+
+/* Create an OpenGL 4.1 core context on a surfaceless EGL display, no window system needed */
+bool GLWrapper::createHeadlessContext(GLWrapper *share) {
+#ifdef GLWRAPPER_USE_EGL
+    EGLDisplay display = EGL_NO_DISPLAY;
+
+    // Prefer Mesa's surfaceless platform, it works on machines with no X server or GPU
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        cerr << "EGL: no display available" << endl;
+        return false;
+    }
+    eglDisplay = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        cerr << "EGL: desktop OpenGL is not supported" << endl;
+        return false;
+    }
+
+    // EGL_SURFACE_TYPE defaults to EGL_WINDOW_BIT, which surfaceless displays never offer
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+        cerr << "EGL: no suitable framebuffer config" << endl;
+        return false;
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 1,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    EGLContext shareContext = share ? (EGLContext) share->eglContext : EGL_NO_CONTEXT;
+    EGLContext context = eglCreateContext(display, config, shareContext, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        cerr << "EGL: could not create an OpenGL 4.1 core context" << endl;
+        return false;
+    }
+    eglContext = context;
+
+    // Without EGL_KHR_surfaceless_context a context must be bound to some surface
+    EGLSurface surface = EGL_NO_SURFACE;
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+        const EGLint pbufferAttribs[] = {EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE};
+        surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+        eglSurface = surface;
+    }
+
+    if (!eglMakeCurrent(display, surface, surface, context)) {
+        cerr << "EGL: could not make the context current" << endl;
+        return false;
+    }
+
+    if (!share && !loadGL((GLADloadproc) eglGetProcAddress)) {
+        cerr << "Failed to initialize GLAD" << endl;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+/* Resolve the GL entry points: only the ones this target references when it was built with a
+   manifest (see cmake/gl_manifest.cmake), otherwise everything glad knows */
+bool GLWrapper::loadGL(GLADloadproc load) {
+#ifdef GLWRAPPER_GL_MANIFEST
+    return gladLoadGLManifest(load, gladManifestNames, gladManifestCount) != 0;
+#else
+    return gladLoadGLLoader(load) != 0;
+#endif
+}
+
+/* The function GL entry points are looked up with for this view's context */
+GLADloadproc GLWrapper::getProcAddressLoader() {
+#ifdef GLWRAPPER_USE_EGL
+    if (eglContext) return (GLADloadproc) eglGetProcAddress;
+#endif
+    return (GLADloadproc) glfwGetProcAddress;
+}
+
+
+/* Create the framebuffer that headless frames are drawn into and leave it bound,
+   so renderers that only ever draw to framebuffer 0 need no changes */
+void GLWrapper::createOffscreenTarget() {
+    glGenRenderbuffers(1, &offscreenColour);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenColour);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &offscreenDepth);
+    glBindRenderbuffer(GL_RENDERBUFFER, offscreenDepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &offscreenFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreenFBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColour);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, offscreenDepth);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        throw runtime_error("Offscreen framebuffer is incomplete");
+    }
+
+    glViewport(0, 0, width, height);
+}
+
+
+/* Destroy the offscreen target, the context and window, and shut GLFW down after the last wrapper */
+void GLWrapper::releaseContext() {
+    if (offscreenFBO) {
+        makeCurrent();
+        glDeleteFramebuffers(1, &offscreenFBO);
+        glDeleteRenderbuffers(1, &offscreenColour);
+        glDeleteRenderbuffers(1, &offscreenDepth);
+        offscreenFBO = offscreenColour = offscreenDepth = 0;
+    }
+
+#ifdef GLWRAPPER_USE_EGL
+    if (eglDisplay) {
+        eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (eglSurface) eglDestroySurface(eglDisplay, eglSurface);
+        if (eglContext) eglDestroyContext(eglDisplay, eglContext);
+        // The display is shared by every headless wrapper, terminating it destroys all their contexts
+        if (liveInstances == 1) eglTerminate(eglDisplay);
+        eglDisplay = eglContext = eglSurface = nullptr;
+    }
+#endif
+
+    if (window) {
+        glfwDestroyWindow(window);
+        window = nullptr;
+    }
+
+    if (--liveInstances == 0) glfwTerminate();
+}
+
+void GLWrapper::getFramebufferSize(int &width, int &height) {
+    if (window && !headless) {
+        glfwGetFramebufferSize(window, &width, &height);
+    } else {
+        width = this->width;
+        height = this->height;
+    }
 }
 
 /* Returns the GLFW window handle, required to call GLFW functions outside this class */
@@ -111,21 +395,415 @@ GLFW_Main function normally starts the window system, calls any init routines
 and then starts the event loop which runs until the program ends
 */
 int GLWrapper::eventLoop() {
+    vector<GLWrapper *> views(1, this);
+    return eventLoop(views);
+}
+
+
+/*
+Event loop for several windows in one process. The first wrapper is the primary view: its
+frame rate, update callback, frame limit and frame stats drive the loop, and input for the
+update callback is still read with its pollInput(). Every view that is still open is drawn
+each frame with its own renderer and its own context made current.
+*/
+int GLWrapper::eventLoop(const vector<GLWrapper *> &views) {
+    typedef FramePacer::Clock Clock;
+
+    GLWrapper *primary = views[0];
+    FramePacer &pacer = primary->pacer;
+    bool multiView = views.size() > 1;
+
+    // Only one window waits for vertical sync, otherwise every extra window would divide the frame rate
+    for (size_t i = 0; i < views.size(); i++) {
+        if (!views[i]->window) continue;
+        glfwMakeContextCurrent(views[i]->window);
+        views[i]->applySwapInterval(i + 1 == views.size() ? primary->swapInterval : 0);
+    }
+    primary->makeCurrent();
+
+    // Fences are only needed to limit queued frames or to fill in the latency column of the stats
+    FrameFences &fences = primary->frameFences;
+    bool useFences = fences.getMaxFramesInFlight() > 0 || primary->frameStats;
+
+    pacer.reset();
+    int frames = 0;
+    Clock::time_point frameStart = Clock::now();
+    Clock::time_point lastPoll = frameStart;
+
+    // A separate thread would make the number of steps per frame depend on timing again
+    bool threaded = primary->threadedUpdate && !primary->deterministic;
+    if (threaded && primary->updater) primary->startUpdateThread();
+    primary->nextScriptedInput = 0;
+
     // Main loop
-    while (!glfwWindowShouldClose(window)) {
+    while (primary->running) {
+        // Closed windows are hidden and skipped, the loop ends once every view is closed
+        bool anyOpen = false;
+        for (GLWrapper *view : views) {
+            if (view->isOpen()) {
+                anyOpen = true;
+            } else if (view->window && glfwGetWindowAttrib(view->window, GLFW_VISIBLE)) {
+                glfwHideWindow(view->window);
+            }
+        }
+        if (!anyOpen) break;
+
+        if (primary->deterministic) primary->queueScriptedInput(frames);
+
+        // Run as many fixed simulation steps as the elapsed real time requires
+        int steps = pacer.advance();
+        if (primary->updater && !threaded) {
+            if (steps > 0) primary->updateRequested = false;
+            double dt = pacer.getFixedTimestep();
+            for (int i = 0; i < steps; i++) {
+                primary->updater(dt);
+            }
+        }
+
+        // Work out which views want a frame. If none do (render-on-demand with nothing dirty, or
+        // background windows over their frame rate cap) sleep until an event arrives. Input and
+        // window events wake the wait by themselves, so only wake up for the next update step if
+        // input is still waiting for it or the update callback asked to keep running.
+        Clock::time_point now = Clock::now();
+        bool ticking = primary->updater && !threaded
+                && (primary->updateRequested || !primary->inputQueue.empty());
+        double timeout = ticking ? pacer.getFixedTimestep() : IDLE_WAIT;
+        // Swap in shaders that were rebuilt since the last frame (see watchShader()),
+        // programs are shared so every view redraws with them
+        bool reloaded = false;
+        for (GLWrapper *view : views) {
+            if (!view->shaderReloader || !view->shaderReloader->hasPending()) continue;
+            if (multiView) view->makeCurrent();
+            if (view->shaderReloader->update() > 0) reloaded = true;
+        }
+
+        int toDraw = 0;
+        for (GLWrapper *view : views) {
+            view->drawThisFrame = view->isOpen()
+                    && (primary->deterministic || reloaded || view->wantsFrame(now, timeout));
+            if (view->drawThisFrame) toDraw++;
+        }
+        if (toDraw == 0) {
+            glfwWaitEventsTimeout(timeout);
+            frameStart = Clock::now();
+            continue;
+        }
+
+        // Low-latency mode: do not start on a new frame while too many are still queued on the GPU.
+        // Sync objects are shared, but the wait has to flush the context the fences were made in.
+        if (useFences) {
+            if (multiView) primary->makeCurrent();
+            fences.throttle();
+        }
+
         // Call function to draw your graphics
-        renderer();
+        Clock::time_point renderStart = Clock::now();
+        for (GLWrapper *view : views) {
+            if (!view->drawThisFrame) continue;
+            if (multiView) view->makeCurrent();
+
+            if (view->interpolatedRenderer) {
+                view->interpolatedRenderer(pacer.getAlpha());
+            } else if (view->viewRenderer) {
+                view->viewRenderer(view);
+            } else if (view->renderer) {
+                view->renderer();
+            }
+            view->glState.endFrame();
+        }
 
-        // Swap buffers
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        Clock::time_point swapStart = Clock::now();
+        for (GLWrapper *view : views) {
+            if (!view->drawThisFrame) continue;
+
+            if (view->headless) {
+                // Nothing to present, just make sure the frame is submitted
+                if (multiView) view->makeCurrent();
+                glFlush();
+            } else {
+                // Swap buffers
+                glfwSwapBuffers(view->window);
+            }
+        }
+
+        // Fence the frame, tagged with when its input was sampled: the oldest event the update
+        // callback took this frame, or else the last poll (the newest input it could have seen)
+        if (useFences) {
+            if (multiView) primary->makeCurrent();
+            Clock::rep inputTime = primary->pendingInputTime.exchange(0);
+            fences.submit(inputTime ? Clock::time_point(Clock::duration(inputTime)) : lastPoll);
+            fences.collect();
+
+            double latency = fences.takeLatency();
+            if (latency >= 0) primary->lastLatency = latency;
+        }
+
+        Clock::time_point pollStart = Clock::now();
+        if (primary->window) glfwPollEvents();
+        Clock::time_point pollEnd = Clock::now();
+        lastPoll = pollEnd;
+
+        frames++;
+        if (primary->frameLimit > 0 && frames >= primary->warmupFrames + primary->frameLimit) {
+            primary->running = false;
+        }
+
+        // Hold the frame until the target frame time set by setFPS() is reached
+        pacer.waitForNextFrame();
+
+        if (primary->frameStats) {
+            Clock::time_point frameEnd = Clock::now();
+            FrameStats::Sample sample;
+            sample.frame = chrono::duration<double, milli>(frameEnd - frameStart).count();
+            sample.render = chrono::duration<double, milli>(swapStart - renderStart).count();
+            sample.swap = chrono::duration<double, milli>(pollStart - swapStart).count();
+            sample.poll = chrono::duration<double, milli>(pollEnd - pollStart).count();
+            sample.latency = useFences ? primary->lastLatency : -1;
+            primary->frameStats->record(sample);
+            if (frames == primary->warmupFrames) {
+                // Everything reported covers the measured frames only
+                primary->frameStats->clear();
+                for (GLWrapper *view : views) view->glState.resetCounts();
+            }
+            frameStart = frameEnd;
+        } else {
+            frameStart = Clock::now();
+        }
     }
 
-    glfwTerminate();
+    primary->stopUpdateThread();
+
+    primary->makeCurrent();
+    fences.release();
+
+    // Wait for the GPU so offscreen frames are really rendered before the caller tears down
+    for (GLWrapper *view : views) {
+        if (!view->headless) continue;
+        view->makeCurrent();
+        glFinish();
+    }
+    primary->makeCurrent();
+
+    if (primary->frameStats) primary->reportFrameStats();
+
     return 0;
 }
 
 
+/* Lock the simulation to the frame count, see wrapper_glfw.h */
+void GLWrapper::setDeterministic(bool enable) {
+    this->deterministic = enable;
+    pacer.setLockstep(enable);
+    pacer.setTargetFPS(enable ? 0 : fps);
+}
+
+void GLWrapper::scheduleInput(int frame, const InputEvent &event) {
+    ScriptedInput scripted = {frame, event};
+
+    // Keep the script ordered by frame, events for the same frame stay in the order given
+    auto pos = upper_bound(inputScript.begin(), inputScript.end(), scripted,
+                           [](const ScriptedInput &a, const ScriptedInput &b) { return a.frame < b.frame; });
+    inputScript.insert(pos, scripted);
+}
+
+void GLWrapper::scheduleKeyPress(int frame, int key) {
+    InputEvent event = {InputEvent::KEY, key, 0, GLFW_PRESS, 0, 0, 0, FramePacer::Clock::time_point()};
+    scheduleInput(frame, event);
+    event.action = GLFW_RELEASE;
+    scheduleInput(frame + 1, event);
+}
+
+/* Queue the scripted events for this frame, stamped with the current time for latency tracking */
+void GLWrapper::queueScriptedInput(int frame) {
+    while (nextScriptedInput < inputScript.size() && inputScript[nextScriptedInput].frame <= frame) {
+        InputEvent event = inputScript[nextScriptedInput++].event;
+        event.time = FramePacer::Clock::now();
+        if (!inputQueue.push(event)) droppedInput++;
+    }
+}
+
+double GLWrapper::getTime() const {
+    if (deterministic) return pacer.getSimulationTime();
+    return chrono::duration<double>(FramePacer::Clock::now() - createdAt).count();
+}
+
+
+/* Set the swap interval of this view's window, its context must be current */
+void GLWrapper::applySwapInterval(int interval) {
+    if (interval < 0 && !glfwExtensionSupported("WGL_EXT_swap_control_tear")
+            && !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+        cout << "Adaptive vsync is not supported, using a swap interval of 1" << endl;
+        interval = 1;
+    }
+    glfwSwapInterval(interval);
+}
+
+
+/* False once the user has asked to close the window (never for a windowless headless context) */
+bool GLWrapper::isOpen() {
+    return !(window && glfwWindowShouldClose(window));
+}
+
+
+/* Decide whether this view draws in the frame starting at `now`. Render-on-demand views only
+   draw when dirty, and at most idleFPS times a second while unfocused. `timeout` is shortened
+   to the time left until a throttled view may draw again. */
+bool GLWrapper::wantsFrame(FramePacer::Clock::time_point now, double &timeout) {
+    typedef FramePacer::Clock Clock;
+
+    if (!renderOnDemand || !window) return true;
+    if (iconified) return false;
+
+    if (!focused && now < nextIdleFrame) {
+        timeout = min(timeout, chrono::duration<double>(nextIdleFrame - now).count());
+        return false;
+    }
+    if (!redrawRequested.exchange(false)) return false;
+
+    if (!focused && idleFPS > 0) {
+        nextIdleFrame = now + chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / idleFPS));
+    }
+    return true;
+}
+
+
+/* Make this view's context current on the calling thread */
+void GLWrapper::makeCurrent() {
+    if (window) {
+        glfwMakeContextCurrent(window);
+    }
+#ifdef GLWRAPPER_USE_EGL
+    else if (eglDisplay) {
+        eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext);
+    }
+#endif
+}
+
+
+void GLWrapper::doneCurrent() {
+#ifdef GLWRAPPER_USE_EGL
+    if (eglDisplay) {
+        eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        return;
+    }
+#endif
+    glfwMakeContextCurrent(nullptr);
+}
+
+
+/* Ask the event loop to render another frame in render-on-demand mode */
+void GLWrapper::requestRedraw() {
+    redrawRequested = true;
+
+    // Wake the event loop if it is blocked waiting for events
+    if (renderOnDemand && window) glfwPostEmptyEvent();
+}
+
+/* Forward resizes to the user's reshape callback with this window's context current */
+void GLWrapper::framebufferSizeCallback(GLFWwindow *window, int w, int h) {
+    GLWrapper *glw = fromWindow(window);
+    glw->redrawRequested = true;
+
+    if (!glw->userReshapeCallback) return;
+    if (liveInstances > 1) glfwMakeContextCurrent(window);
+    glw->glState.invalidate();
+    glw->userReshapeCallback(window, w, h);
+}
+
+/* The window was exposed or resized and its contents need repainting */
+void GLWrapper::windowRefreshCallback(GLFWwindow *window) {
+    GLWrapper *glw = fromWindow(window);
+    glw->redrawRequested = true;
+}
+
+void GLWrapper::windowFocusCallback(GLFWwindow *window, int focused) {
+    GLWrapper *glw = fromWindow(window);
+    glw->focused = focused == GLFW_TRUE;
+    glw->redrawRequested = true;
+}
+
+void GLWrapper::windowIconifyCallback(GLFWwindow *window, int iconified) {
+    GLWrapper *glw = fromWindow(window);
+    glw->iconified = iconified == GLFW_TRUE;
+    glw->redrawRequested = true;
+}
+
+
+/* Run the update callback on a separate thread at the fixed timestep until stopUpdateThread() */
+void GLWrapper::startUpdateThread() {
+    updateThreadRunning = true;
+    updateThread = thread([this]() {
+        typedef FramePacer::Clock Clock;
+
+        // A private clock decides how many steps are due, in between the thread just
+        // sleeps. There is no frame to present, so no need to spin like the render loop.
+        FramePacer clock;
+        double dt = pacer.getFixedTimestep();
+        clock.setFixedTimestep(dt);
+        Clock::duration step = chrono::duration_cast<Clock::duration>(chrono::duration<double>(dt));
+        Clock::time_point next = Clock::now();
+
+        while (updateThreadRunning.load(memory_order_relaxed)) {
+            int steps = clock.advance();
+            for (int i = 0; i < steps; i++) {
+                updater(dt);
+            }
+            next += step;
+            if (next < Clock::now()) next = Clock::now() + step;
+            this_thread::sleep_until(next);
+        }
+    });
+}
+
+void GLWrapper::stopUpdateThread() {
+    if (!updateThread.joinable()) return;
+
+    updateThreadRunning = false;
+    updateThread.join();
+}
+
+
+/* Start recording per-frame timings, keeping the most recent `capacity` frames */
+void GLWrapper::enableFrameStats(size_t capacity) {
+    delete frameStats;
+    frameStats = new FrameStats(capacity);
+}
+
+/* Files that reportFrameStats() writes the raw samples to, either may be nullptr */
+void GLWrapper::setFrameStatsFiles(const char *csvPath, const char *jsonPath) {
+    this->statsCSVPath = csvPath;
+    this->statsJSONPath = jsonPath;
+}
+
+/* Print the frame time summary and write any requested CSV/JSON files.
+   Called automatically when the event loop exits, can also be called at any time. */
+void GLWrapper::reportFrameStats() {
+    if (!frameStats) return;
+
+    frameStats->report(cout);
+
+    // Only counts calls made through getState()
+    GLState::Counts total = glState.getTotal();
+    if (total.calls > 0) {
+        size_t frames = glState.getFrames();
+        cout << "GL state calls per frame: " << double(total.calls) / frames << ", elided "
+                << double(total.elided) / frames << " (" << 100.0 * total.elided / total.calls << "%)" << endl;
+    }
+    if (bufferHeap) {
+        BufferHeap::Stats heap = bufferHeap->getStats();
+        cout << "Buffer heap: " << heap.pages << " pages, " << heap.blocks << " blocks, " << heap.bytesUsed
+                << " bytes used, " << heap.bytesFree << " free in " << heap.freeRegions << " regions, fragmentation "
+                << heap.fragmentation << ", " << heap.blocksMoved << " blocks moved by compact()" << endl;
+    }
+    if (statsCSVPath && !frameStats->writeCSV(statsCSVPath)) {
+        cerr << "Could not write frame stats to " << statsCSVPath << endl;
+    }
+    if (statsJSONPath && !frameStats->writeJSON(statsJSONPath)) {
+        cerr << "Could not write frame stats to " << statsJSONPath << endl;
+    }
+}
+
+
 /* Register an error callback function */
 void GLWrapper::setErrorCallback(void (*func)(int error, const char *description)) {
     glfwSetErrorCallback(func);
@@ -134,17 +812,89 @@ void GLWrapper::setErrorCallback(void (*func)(int error, const char *description
 /* Register a display function that renders in the window */
 void GLWrapper::setRenderer(void (*func)()) {
     this->renderer = func;
+    this->interpolatedRenderer = nullptr;
+    this->viewRenderer = nullptr;
+}
+
+/* Register a display function that is given the interpolation factor between simulation steps */
+void GLWrapper::setRenderer(void (*func)(double alpha)) {
+    this->interpolatedRenderer = func;
+    this->renderer = nullptr;
+    this->viewRenderer = nullptr;
+}
+
+/* Register a display function that is passed the wrapper of the view being drawn */
+void GLWrapper::setRenderer(void (*func)(GLWrapper *glw)) {
+    this->viewRenderer = func;
+    this->renderer = nullptr;
+    this->interpolatedRenderer = nullptr;
+}
+
+/* Register a function that advances the simulation by a fixed time step */
+void GLWrapper::setUpdateCallback(void (*func)(double dt)) {
+    this->updater = func;
 }
 
 /* Register a callback that runs after the window gets resized */
 void GLWrapper::setReshapeCallback(void (*func)(GLFWwindow *window, int w, int h)) {
-    glfwSetFramebufferSizeCallback(window, func);
+    this->userReshapeCallback = func;
 }
 
 
 /* Register a callback to respond to keyboard events */
 void GLWrapper::setKeyCallback(void (*func)(GLFWwindow *window, int key, int scancode, int action, int mods)) {
-    glfwSetKeyCallback(window, func);
+    this->userKeyCallback = func;
+}
+
+
+/* Take the input queued since the last call as one batch */
+InputEvents GLWrapper::pollInput() {
+    InputEvents batch;
+    batch.events = inputBatch;
+    batch.count = inputQueue.popAll(inputBatch, INPUT_QUEUE_SIZE);
+
+    // Remember the oldest input handed out until the event loop fences the frame that shows it
+    if (batch.count > 0) {
+        FramePacer::Clock::rep none = 0;
+        pendingInputTime.compare_exchange_strong(none, inputBatch[0].time.time_since_epoch().count());
+    }
+    return batch;
+}
+
+void GLWrapper::queueInput(const InputEvent &event) {
+    if (deterministic) return;
+    if (!inputQueue.push(event)) droppedInput++;
+}
+
+void GLWrapper::keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+    GLWrapper *glw = fromWindow(window);
+
+    InputEvent event = {InputEvent::KEY, key, scancode, action, mods, 0, 0, FramePacer::Clock::now()};
+    glw->queueInput(event);
+
+    if (glw->userKeyCallback) glw->userKeyCallback(window, key, scancode, action, mods);
+}
+
+void GLWrapper::mouseButtonCallback(GLFWwindow *window, int button, int action, int mods) {
+    GLWrapper *glw = fromWindow(window);
+
+    InputEvent event = {InputEvent::MOUSE_BUTTON, button, 0, action, mods, 0, 0, FramePacer::Clock::now()};
+    glfwGetCursorPos(window, &event.x, &event.y);
+    glw->queueInput(event);
+}
+
+void GLWrapper::cursorPosCallback(GLFWwindow *window, double x, double y) {
+    GLWrapper *glw = fromWindow(window);
+
+    InputEvent event = {InputEvent::CURSOR, 0, 0, 0, 0, x, y, FramePacer::Clock::now()};
+    glw->queueInput(event);
+}
+
+void GLWrapper::scrollCallback(GLFWwindow *window, double dx, double dy) {
+    GLWrapper *glw = fromWindow(window);
+
+    InputEvent event = {InputEvent::SCROLL, 0, 0, 0, 0, dx, dy, FramePacer::Clock::now()};
+    glw->queueInput(event);
 }
 
 
@@ -192,6 +942,9 @@ GLuint GLWrapper::BuildShader(GLenum eShaderType, const string &shaderText) {
 
 /* Read a text file into a string*/
 string GLWrapper::readFile(const char *filePath) {
+    const EmbeddedShader *embedded = useEmbeddedShaders ? findEmbeddedShader(filePath) : nullptr;
+    if (embedded) return string(embedded->source, embedded->length);
+
     string content;
     ifstream fileStream(filePath, ios::in);
 
@@ -210,13 +963,136 @@ string GLWrapper::readFile(const char *filePath) {
     return content;
 }
 
+void GLWrapper::setUseEmbeddedShaders(bool enable) {
+    useEmbeddedShaders = enable;
+    preprocessor.setUseEmbedded(enable);
+}
+
+/* Start caching program binaries on disk, see wrapper_glfw.h */
+void GLWrapper::enableProgramCache(const char *directory) {
+    delete programCache;
+    programCache = new ProgramCache(directory);
+    if (buildQueue) buildQueue->setCache(programCache);
+    if (!programCache->isSupported()) {
+        cout << "Program cache: the driver offers no program binary formats, shaders are always compiled" << endl;
+    }
+}
+
+/* Create and link a program, asking the driver to keep the binary around when it is going to be cached */
+GLuint GLWrapper::linkProgram(GLuint vertShader, GLuint fragShader, uint64_t cacheKey) {
+    GLuint program = glCreateProgram();
+    if (programCache) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(program, vertShader);
+    glAttachShader(program, fragShader);
+    glLinkProgram(program);
+
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (programCache && status == GL_TRUE) programCache->store(cacheKey, program);
+    return program;
+}
+
+ShaderBuildQueue &GLWrapper::getShaderBuildQueue() {
+    if (!buildQueue) buildQueue = new ShaderBuildQueue(getProcAddressLoader(), programCache);
+    return *buildQueue;
+}
+
+void GLWrapper::watchShader(const char *vertex_path, const char *fragment_path, GLuint *program,
+                            void (*onReload)(GLuint program)) {
+    if (!shaderReloader) shaderReloader = new ShaderReloader(this);
+    shaderReloader->watch(vertex_path, fragment_path, program, onReload);
+}
+
+/* Read vertex and fragment shader and submit them to the build queue */
+ShaderBuildQueue::Handle GLWrapper::LoadShaderAsync(const char *vertex_path, const char *fragment_path) {
+    uint64_t embeddedHash = ProgramCache::FNV_OFFSET;
+    string vertShaderStr = readShader(vertex_path);
+    bool embedded = addEmbeddedHashes(embeddedHash);
+    string fragShaderStr = readShader(fragment_path);
+    embedded = addEmbeddedHashes(embeddedHash) && embedded;
+
+    optimizeProgram(vertShaderStr, fragShaderStr);
+    uint64_t cacheKey = programKey(vertShaderStr, fragShaderStr, embedded, embeddedHash);
+    return getShaderBuildQueue().submit(vertShaderStr, fragShaderStr, cacheKey);
+}
+
+GLuint GLWrapper::LoadShaderVariant(const char *vertex_path, const char *fragment_path, const ShaderDefines &defines) {
+    if (!shaderVariants) shaderVariants = new ShaderVariants(this);
+    return shaderVariants->get(vertex_path, fragment_path, defines);
+}
+
+ShaderPipelines &GLWrapper::getShaderPipelines() {
+    if (!shaderPipelines) shaderPipelines = new ShaderPipelines(this);
+    return *shaderPipelines;
+}
+
+UniformRing &GLWrapper::getUniformRing() {
+    if (!uniformRing) uniformRing = new UniformRing();
+    return *uniformRing;
+}
+
+BufferHeap &GLWrapper::getBufferHeap() {
+    if (!bufferHeap) bufferHeap = new BufferHeap();
+    return *bufferHeap;
+}
+
+string GLWrapper::optimizeShader(const string &shaderText) {
+    return optimizeShaders ? ShaderOptimizer::optimize(shaderText, &optimizerStats) : shaderText;
+}
+
+/* Optimise a vertex/fragment pair. Every build path calls this before computing its program
+   cache key, so the key always describes the exact text given to glShaderSource(). */
+void GLWrapper::optimizeProgram(string &vertShaderStr, string &fragShaderStr) {
+    if (!optimizeShaders) return;
+    vertShaderStr = optimizeShader(ShaderOptimizer::pruneVaryings(vertShaderStr, fragShaderStr, &optimizerStats));
+    fragShaderStr = optimizeShader(fragShaderStr);
+}
+
+bool GLWrapper::addEmbeddedHashes(uint64_t &hash) {
+    if (!useEmbeddedShaders) return false;
+    for (const string &file : preprocessor.getFiles()) {
+        const EmbeddedShader *embedded = findEmbeddedShader(file.c_str());
+        if (!embedded) return false;
+        hash = ProgramCache::hash(&embedded->pathHash, sizeof(embedded->pathHash), hash);
+        hash = ProgramCache::hash(&embedded->sourceHash, sizeof(embedded->sourceHash), hash);
+    }
+    return true;
+}
+
+uint64_t GLWrapper::programKey(const string &vertShaderStr, const string &fragShaderStr, bool embedded,
+                               uint64_t embeddedHash) {
+    if (!programCache) return 0;
+    if (!embedded) return programCache->key({vertShaderStr, fragShaderStr});
+
+    // The compiled text follows from the embedded sources and whether it was optimised
+    uint64_t optimized = optimizeShaders;
+    return programCache->key({embeddedHash, optimized});
+}
+
+/* Read a shader file and run it through the preprocessor */
+string GLWrapper::readShader(const char *filePath, const ShaderDefines &defines) {
+    string source = readFile(filePath);
+    return preprocessor.processSource(source, filePath, defines);
+}
+
 /* Load vertex and fragment shader and return the compiled program */
 GLuint GLWrapper::LoadShader(const char *vertex_path, const char *fragment_path) {
     GLuint vertShader, fragShader;
 
-    // Read shaders
-    string vertShaderStr = readFile(vertex_path);
-    string fragShaderStr = readFile(fragment_path);
+    // Read shaders, noting whether they came from the embedded copies
+    uint64_t embeddedHash = ProgramCache::FNV_OFFSET;
+    string vertShaderStr = readShader(vertex_path);
+    bool embedded = addEmbeddedHashes(embeddedHash);
+    string fragShaderStr = readShader(fragment_path);
+    embedded = addEmbeddedHashes(embeddedHash) && embedded;
+    optimizeProgram(vertShaderStr, fragShaderStr);
+
+    // A cached binary skips both compiling and linking
+    uint64_t cacheKey = programKey(vertShaderStr, fragShaderStr, embedded, embeddedHash);
+    if (programCache) {
+        GLuint cached = programCache->load(cacheKey);
+        if (cached) return cached;
+    }
 
     GLint result = GL_FALSE;
     int logLength;
@@ -225,10 +1101,7 @@ GLuint GLWrapper::LoadShader(const char *vertex_path, const char *fragment_path)
     fragShader = BuildShader(GL_FRAGMENT_SHADER, fragShaderStr);
 
     cout << "Linking program" << endl;
-    GLuint program = glCreateProgram();
-    glAttachShader(program, vertShader);
-    glAttachShader(program, fragShader);
-    glLinkProgram(program);
+    GLuint program = linkProgram(vertShader, fragShader, cacheKey);
 
     glGetProgramiv(program, GL_LINK_STATUS, &result);
     glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
@@ -247,6 +1120,14 @@ GLuint GLWrapper::BuildShaderProgram(string vertShaderStr, string fragShaderStr)
     GLuint vertShader, fragShader;
     GLint result = GL_FALSE;
 
+    optimizeProgram(vertShaderStr, fragShaderStr);
+    uint64_t cacheKey = 0;
+    if (programCache) {
+        cacheKey = programCache->key({vertShaderStr, fragShaderStr});
+        GLuint cached = programCache->load(cacheKey);
+        if (cached) return cached;
+    }
+
     try {
         vertShader = BuildShader(GL_VERTEX_SHADER, vertShaderStr);
         fragShader = BuildShader(GL_FRAGMENT_SHADER, fragShaderStr);
@@ -257,10 +1138,7 @@ GLuint GLWrapper::BuildShaderProgram(string vertShaderStr, string fragShaderStr)
         throw runtime_error("BuildShaderProgram() Build shader failure. Abandoning");
     }
 
-    GLuint program = glCreateProgram();
-    glAttachShader(program, vertShader);
-    glAttachShader(program, fragShader);
-    glLinkProgram(program);
+    GLuint program = linkProgram(vertShader, fragShader, cacheKey);
 
     GLint status;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
@@ -6,11 +6,30 @@ Iain Martin August 2014
 #pragma once
 
 #include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
 
 /* Inlcude GL_Load and GLFW */
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "frame_pacer.h"
+#include "frame_fences.h"
+#include "frame_stats.h"
+#include "gl_state.h"
+#include "input_queue.h"
+#include "program_cache.h"
+#include "shader_build_queue.h"
+#include "shader_preprocessor.h"
+#include "shader_optimizer.h"
+
+class ShaderReloader;
+class ShaderVariants;
+class ShaderPipelines;
+class UniformRing;
+class BufferHeap;
+
 class GLWrapper {
 private:
     int width;
@@ -20,39 +39,444 @@ private:
 
     void (*renderer)();
 
+    void (*interpolatedRenderer)(double alpha);
+
+    void (*viewRenderer)(GLWrapper *glw);
+
+    void (*updater)(double dt);
+    std::atomic<bool> updateRequested; // Set by keepUpdating(), cleared before each batch of steps
+
+    FramePacer pacer;
+
+    /* Swap interval for the window that paces the loop, -1 is adaptive vsync */
+    int swapInterval;
+
+    void applySwapInterval(int interval);
+
+    /* Frames the GPU has not finished yet, and the input timestamps used to estimate latency */
+    FrameFences frameFences;
+    std::atomic<FramePacer::Clock::rep> pendingInputTime;
+    double lastLatency;
+
+    /* Shadow of this context's bindings, see getState() */
+    GLState glState;
+
+    /* Optional simulation thread that runs the update callback instead of the event loop */
+    bool threadedUpdate;
+    std::atomic<bool> updateThreadRunning;
+    std::thread updateThread;
+
+    void startUpdateThread();
+
+    void stopUpdateThread();
+
+    /* Render-on-demand: only draw when something asked for a redraw, and throttle
+       to idleFPS while the window is in the background */
+    bool renderOnDemand;
+    std::atomic<bool> redrawRequested;
+    double idleFPS;
+    bool focused;
+    bool iconified;
+    FramePacer::Clock::time_point nextIdleFrame;
+    bool drawThisFrame;
+
+    bool isOpen();
+
+    bool wantsFrame(FramePacer::Clock::time_point now, double &timeout);
+
+    static void windowRefreshCallback(GLFWwindow *window);
+
+    static void windowFocusCallback(GLFWwindow *window, int focused);
+
+    static void windowIconifyCallback(GLFWwindow *window, int iconified);
+
+    /* Input events are queued by the GLFW callbacks below and taken in batches by pollInput() */
+    static const size_t INPUT_QUEUE_SIZE = 1024;
+    SpscRing<InputEvent, INPUT_QUEUE_SIZE> inputQueue;
+    InputEvent inputBatch[INPUT_QUEUE_SIZE];
+    std::atomic<size_t> droppedInput;
+
+    /* Deterministic mode: live input is ignored and these events are queued at fixed frames instead */
+    struct ScriptedInput {
+        int frame;
+        InputEvent event;
+    };
+    bool deterministic;
+    std::vector<ScriptedInput> inputScript;
+    size_t nextScriptedInput;
+    int warmupFrames;
+    FramePacer::Clock::time_point createdAt;
+
+    void queueScriptedInput(int frame);
+
+    void (*userKeyCallback)(GLFWwindow *window, int key, int scancode, int action, int mods);
+
+    void (*userReshapeCallback)(GLFWwindow *window, int w, int h);
+
+    void *userData;
+
+    static void framebufferSizeCallback(GLFWwindow *window, int w, int h);
+
+    void queueInput(const InputEvent &event);
+
+    static void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods);
+
+    static void mouseButtonCallback(GLFWwindow *window, int button, int action, int mods);
+
+    static void cursorPosCallback(GLFWwindow *window, double x, double y);
+
+    static void scrollCallback(GLFWwindow *window, double dx, double dy);
+
     bool running;
     GLFWwindow *window;
 
+    /* Headless rendering: no visible window, frames go to an offscreen framebuffer */
+    bool headless;
+    int frameLimit;
+    GLuint offscreenFBO;
+    GLuint offscreenColour;
+    GLuint offscreenDepth;
+
+    /* EGL handles for the surfaceless context, only used when built with GLWRAPPER_USE_EGL */
+    void *eglDisplay;
+    void *eglContext;
+    void *eglSurface;
+
+    /* Frame timing, only allocated once enableFrameStats() is called */
+    FrameStats *frameStats;
+    const char *statsCSVPath;
+    const char *statsJSONPath;
+
+    /* Linked programs saved between runs, only allocated once enableProgramCache() is called */
+    ProgramCache *programCache;
+
+    GLuint linkProgram(GLuint vertShader, GLuint fragShader, uint64_t cacheKey);
+
+    /* Created by the first LoadShaderAsync() or getShaderBuildQueue() call */
+    ShaderBuildQueue *buildQueue;
+
+    /* Created by the first watchShader() call */
+    ShaderReloader *shaderReloader;
+
+    /* #include, define and conditional handling for every shader loaded from a file */
+    ShaderPreprocessor preprocessor;
+
+    /* Take shaders compiled into the executable (GLWRAPPER_EMBED_SHADERS) before files on disk */
+    bool useEmbeddedShaders;
+
+    /* Run sources through ShaderOptimizer before glShaderSource, see setShaderOptimization() */
+    bool optimizeShaders;
+    ShaderOptimizer::Stats optimizerStats;
+
+    /* optimizeShader() on both stages, pruning the varyings the fragment stage ignores first */
+    void optimizeProgram(std::string &vertShaderStr, std::string &fragShaderStr);
+
+    /* After readShader(): true if every file it read was embedded, with their build-time hashes
+       added to `hash`, so the program cache key needs no hashing of the text */
+    bool addEmbeddedHashes(uint64_t &hash);
+
+    /* Program cache key for a pair read with readShader() and optimised, 0 without a cache */
+    uint64_t programKey(const std::string &vertShaderStr, const std::string &fragShaderStr, bool embedded,
+                        uint64_t embeddedHash);
+
+    /* Created by the first LoadShaderVariant() call */
+    ShaderVariants *shaderVariants;
+
+    /* Created by the first getShaderPipelines() call */
+    ShaderPipelines *shaderPipelines;
+
+    /* Created by the first getUniformRing() call */
+    UniformRing *uniformRing;
+
+    /* Created by the first getBufferHeap() call */
+    BufferHeap *bufferHeap;
+
+    /* Wrappers alive in this process, GLFW (and EGL) are shut down when the last one goes */
+    static int liveInstances;
+
+    bool createHeadlessContext(GLWrapper *share);
+
+    static bool loadGL(GLADloadproc load);
+
+    void createOffscreenTarget();
+
+    void releaseContext();
+
 public:
-    GLWrapper(int width, int height, const char *title);
+    /* headless = true creates an offscreen context that needs no display,
+       see setFrameLimit() to stop the event loop after a fixed number of frames.
+       Passing share puts the new context in the same share group as that wrapper's context, so
+       buffers, textures, shaders and programs created in one can be used in the other. A headless
+       wrapper sharing with a windowed one uses a hidden window, as EGL and GLFW contexts cannot share.
+       Container objects (vertex arrays, framebuffers, program pipelines) are never shared. */
+    GLWrapper(int width, int height, const char *title, bool headless = false, GLWrapper *share = nullptr);
 
     ~GLWrapper();
 
+    /* Cap the frame rate, <= 0 renders as fast as the swap interval allows */
     void setFPS(double fps) {
         this->fps = fps;
+        pacer.setTargetFPS(fps);
+    }
+
+    /* Frames to wait for vertical sync between swaps: 0 = off, 1 = every refresh (default),
+       -1 = adaptive, tears instead of waiting when a frame misses the refresh.
+       Adaptive falls back to 1 if the driver does not support it. */
+    void setSwapInterval(int interval) {
+        this->swapInterval = interval;
+    }
+
+    /* Low-latency mode: block before rendering until fewer than `frames` earlier frames are still
+       queued on the GPU, 1 keeps the CPU no more than one frame ahead. 0 (default) lets the driver
+       queue as many as it likes. Also enables latency estimates, see getLastLatency(). */
+    void setMaxFramesInFlight(int frames) {
+        frameFences.setMaxFramesInFlight(frames);
+    }
+
+    /* Estimated time in ms from input being sampled to the GPU finishing the frame that used it,
+       for the latest finished frame. -1 until measured, which needs setMaxFramesInFlight() or
+       frame stats to be enabled. Present latency of the display itself is not included. */
+    double getLastLatency() const {
+        return lastLatency;
+    }
+
+    /* Deterministic mode for benchmarks: exactly one update step per frame, getTime() follows the
+       frame count, every view draws every frame, no frame rate cap, the update callback always runs
+       on the render thread and live input is replaced by the events given to scheduleInput() */
+    void setDeterministic(bool enable);
+
+    bool isDeterministic() const {
+        return deterministic;
     }
 
+    /* Frames run before the frame limit and frame stats start counting, stats are cleared after them */
+    void setWarmupFrames(int frames) {
+        this->warmupFrames = frames;
+    }
+
+    /* Queue an input event for pollInput() at the start of the given frame (0 = first frame,
+       warmup included), only used in deterministic mode */
+    void scheduleInput(int frame, const InputEvent &event);
+
+    /* Press at `frame` and release on the next frame */
+    void scheduleKeyPress(int frame, int key);
+
+    /* Seconds of animation time: simulation time in deterministic mode, else real time since the
+       wrapper was created. Use instead of glfwGetTime(), which also needs GLFW to be initialised. */
+    double getTime() const;
+
+    /* Simulation step length used for the update callback (default 1/60 s) */
+    void setFixedTimestep(double seconds) {
+        pacer.setFixedTimestep(seconds);
+    }
+
+    /* In render-on-demand mode the event loop sleeps in glfwWaitEventsTimeout() until
+       requestRedraw() is called or the window needs repainting. Ignored when headless. */
+    void setRenderOnDemand(bool enable) {
+        this->renderOnDemand = enable;
+    }
+
+    /* Mark the scene dirty, safe to call from any thread */
+    void requestRedraw();
+
+    /* Frame rate cap while the window is unfocused in render-on-demand mode (default 5) */
+    void setIdleFPS(double fps) {
+        this->idleFPS = fps;
+    }
+
+    /* Stop the event loop after this many frames, 0 runs until the window is closed */
+    void setFrameLimit(int frames) {
+        this->frameLimit = frames;
+    }
+
+    bool isHeadless() const {
+        return headless;
+    }
+
+    /* Framebuffer object that headless frames are rendered into (0 when rendering to a window) */
+    GLuint getFramebuffer() const {
+        return offscreenFBO;
+    }
+
+    /* Size in pixels of what frames are rendered into, the window's framebuffer or the offscreen one */
+    void getFramebufferSize(int &width, int &height);
+
+    void enableFrameStats(size_t capacity = 4096);
+
+    void setFrameStatsFiles(const char *csvPath, const char *jsonPath);
+
+    /* nullptr until enableFrameStats() is called */
+    FrameStats *getFrameStats() {
+        return frameStats;
+    }
+
+    void reportFrameStats();
+
     void DisplayVersion();
 
     /* Callback registering functions */
     void setRenderer(void (*f)());
 
+    /* Renderer that receives the interpolation factor between the last two simulation steps */
+    void setRenderer(void (*f)(double alpha));
+
+    /* Renderer that is told which view it is drawing, for sharing one function between windows */
+    void setRenderer(void (*f)(GLWrapper *glw));
+
+    /* Called zero or more times per frame with a fixed dt, before rendering. In render-on-demand
+       mode an idle loop only runs it when input arrives, unless it calls keepUpdating(). */
+    void setUpdateCallback(void (*f)(double dt));
+
+    /* Call from the update callback to have the next step run even with no input and nothing
+       to draw, e.g. while an animation is playing in render-on-demand mode */
+    void keepUpdating() {
+        updateRequested = true;
+    }
+
+    /* Run the update callback on its own thread at the fixed timestep, so slow simulation
+       steps do not hold up rendering. The callback must not make GL calls and should hand
+       its results to the renderer through a TripleBuffer (see triple_buffer.h). */
+    void setUpdateThread(bool enable) {
+        this->threadedUpdate = enable;
+    }
+
+    /* Called with this window's context current, so glViewport() applies to the right window */
     void setReshapeCallback(void (*f)(GLFWwindow *window, int w, int h));
 
+    /* Called straight from GLFW event processing on the main thread, after the event is queued.
+       Prefer pollInput() for anything that is not tied to the main thread (e.g. closing the window). */
     void setKeyCallback(void (*f)(GLFWwindow *window, int key, int scancode, int action, int mods));
 
+    /* Take every input event queued since the last call, oldest first. Only one thread may
+       consume input: the update callback's thread, or the render thread if updates are not used.
+       The returned view is valid until the next call and no allocation takes place. */
+    InputEvents pollInput();
+
+    /* Events lost because the consumer fell more than INPUT_QUEUE_SIZE events behind */
+    size_t getDroppedInputCount() const {
+        return droppedInput.load();
+    }
+
     void setErrorCallback(void (*f)(int error, const char *description));
 
+    /* Keep linked program binaries in `directory` so LoadShader() and BuildShaderProgram() can
+       skip compiling and linking on later runs. Needs a current context. */
+    void enableProgramCache(const char *directory);
+
+    /* nullptr until enableProgramCache() is called */
+    ProgramCache *getProgramCache() {
+        return programCache;
+    }
+
     /* Shader load and build support functions */
     GLuint LoadShader(const char *vertex_path, const char *fragment_path);
 
+    /* Compiles shaderText as given, callers run it through optimizeShader() first */
     GLuint BuildShader(GLenum eShaderType, const std::string &shaderText);
 
+    /* The text compiled for a single stage: optimised if shader optimisation is on, else unchanged.
+       Program cache keys are computed from this text. */
+    std::string optimizeShader(const std::string &shaderText);
+
+    /* Strip, prune and minify every shader before it is compiled (off by default). Vertex outputs
+       the fragment stage ignores are also demoted when both are built together. Compile errors
+       then refer to the optimised text. */
+    void setShaderOptimization(bool enable) {
+        optimizeShaders = enable;
+    }
+
+    bool getShaderOptimization() const {
+        return optimizeShaders;
+    }
+
+    /* Totals over every shader this wrapper optimised */
+    const ShaderOptimizer::Stats &getShaderOptimizerStats() const {
+        return optimizerStats;
+    }
+
     GLuint BuildShaderProgram(std::string vertShaderStr, std::string fragShaderStr);
 
+    /* Shader files are taken from the executable when it embeds them, see add_embedded_shaders() */
     std::string readFile(const char *filePath);
 
+    /* Off makes readFile() and #include always go to disk, as hot reload needs */
+    void setUseEmbeddedShaders(bool enable);
+
+    /* Read a shader file through the preprocessor: #include resolved, defines injected after #version */
+    std::string readShader(const char *filePath, const ShaderDefines &defines = ShaderDefines());
+
+    ShaderPreprocessor &getShaderPreprocessor() {
+        return preprocessor;
+    }
+
+    /* A permutation of a program built with the given defines, compiled once per distinct
+       preprocessed code and owned by this wrapper. See shader_variants.h. */
+    GLuint LoadShaderVariant(const char *vertex_path, const char *fragment_path, const ShaderDefines &defines);
+
+    /* nullptr until LoadShaderVariant() is first called */
+    ShaderVariants *getShaderVariants() {
+        return shaderVariants;
+    }
+
+    /* Separable stage programs and this context's pipelines combining them, see shader_pipelines.h */
+    ShaderPipelines &getShaderPipelines();
+
+    /* Uniform buffer ring for this context's per-frame and per-draw blocks, see uniform_ring.h */
+    UniformRing &getUniformRing();
+
+    /* Redundant-call filter for this context's program, vertex array, buffer, capability, blend,
+       viewport and texture state, see gl_state.h. The event loop ends its frame after the renderer,
+       and the resize callback invalidates it since reshape functions call glViewport directly. */
+    GLState &getState() {
+        return glState;
+    }
+
+    /* Large shared buffers that mesh vertex and index data is allocated from, see buffer_heap.h.
+       Buffers are shared with contexts created with this one as `share`. */
+    BufferHeap &getBufferHeap();
+
+    /* Start building a program without waiting for the compiler, poll the queue (or call
+       getState()/getProgram() on the handle) to find out when it is ready. Without parallel
+       shader compile support getState()/getProgram() finish the build on the spot. Uses the
+       program cache if it is enabled. */
+    ShaderBuildQueue::Handle LoadShaderAsync(const char *vertex_path, const char *fragment_path);
+
+    /* The queue LoadShaderAsync() submits to, for this view's context */
+    ShaderBuildQueue &getShaderBuildQueue();
+
+    /* Hot reload: rebuild *program in the background whenever either file changes and swap it in
+       between frames, keeping the old program if the new one does not compile. onReload is called
+       with the new program on the render thread, e.g. to look up uniform locations again. */
+    void watchShader(const char *vertex_path, const char *fragment_path, GLuint *program,
+                     void (*onReload)(GLuint program) = nullptr);
+
+    /* Per-window data for callbacks, e.g. the view's own vertex array object */
+    void setUserData(void *data) {
+        this->userData = data;
+    }
+
+    void *getUserData() {
+        return userData;
+    }
+
+    /* The wrapper that owns a GLFW window, for use inside GLFW callbacks */
+    static GLWrapper *fromWindow(GLFWwindow *window) {
+        return (GLWrapper *) glfwGetWindowUserPointer(window);
+    }
+
+    void makeCurrent();
+
+    /* Release whichever context is current on the calling thread, so another thread can take it */
+    void doneCurrent();
+
+    /* glfwGetProcAddress or eglGetProcAddress, whichever created this view's context */
+    GLADloadproc getProcAddressLoader();
+
     int eventLoop();
 
+    /* Run one event loop for several windows, see wrapper_glfw.cpp */
+    static int eventLoop(const std::vector<GLWrapper *> &views);
+
+    /* Returns nullptr for a headless context that was created without a window */
     GLFWwindow *getWindow();
 };
@@ -20,20 +20,52 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
-
-/* Include GL_Load and GLFW headers */
-#include <glad/glad.h>
-#include <GLFW/glfw3.h>
+#include <cmath>
+
+/* Include the GLFW wrapper class, which also includes the GL_Load and GLFW headers.
+   It creates the window (or a headless context) and runs the event loop. */
+#include "wrapper_glfw.h"
+#include "demo_options.h"
+#include "triple_buffer.h"
+#include "shader_program.h"
+#include "uniform_ring.h"
+#include "std_layout.h"
+#include "stream_buffer.h"
+#include "buffer_heap.h"
 
 /* Define some global objects that we'll use to render */
-GLuint positionBufferObject;
-GLuint secondPositionBufferObject; // Personal modification here, to display another triangle
+StreamBuffer *positionStream; // The animated triangle, rewritten every frame
+BufferHeap::Handle secondTriangle; // Personal modification here, to display another triangle
 GLuint program;
-GLuint vao;
+ShaderProgram shader;
+
+/* The uniform blocks of the shaders below, laid out by the std140 rules.
+   FrameData is pushed to the uniform ring once a frame, DrawData once per triangle. */
+typedef Std140<glm::vec2> FrameData; // Padded to a whole vec4
+typedef Std140<glm::vec4> DrawData;
+const GLuint FRAME_DATA_BINDING = 0;
+const GLuint DRAW_DATA_BINDING = 1;
+GLuint vao;       // Reads the buffer heap page with the blue triangle
+GLuint streamVAO; // Reads the stream buffer with the animated triangle
+const GLsizei VERTEX_STRIDE = 4 * sizeof(float);
+
+/* Bytes of heap blocks compact() may copy per frame */
+const GLsizeiptr COMPACT_BUDGET = 64 << 10;
+
+/* Animation variables, only touched by update(), which may run on its own thread */
 GLfloat x;
 GLfloat y; // Personal modification here, to make another vertex move
 GLfloat inc;
 
+/* Snapshot of the animation that update() hands to display() */
+struct AnimationState {
+    GLfloat x;
+    GLfloat y;
+};
+TripleBuffer<AnimationState> animation;
+
+GLWrapper *glw;
+
 double startTime; // Personal modification - For advance feature: Animation speed control
 
 /* Array of vertex positions */
@@ -101,11 +133,6 @@ static void error_callback(int error, const char *description) {
 static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GL_TRUE);
-
-    // Personal modification for feature
-    if (key == GLFW_KEY_C) {
-        y += (GLfloat) 10 * inc;
-    }
 }
 
 /* Window reshape callback
@@ -115,6 +142,15 @@ static void reshape(GLFWwindow *window, int w, int h) {
 }
 
 
+/* Point the heap's vertex array at the page holding the blue triangle, again whenever compaction moves it */
+static void setupHeapVertexArray() {
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, glw->getBufferHeap().buffer(secondTriangle));
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, VERTEX_STRIDE, 0);
+    glEnableVertexAttribArray(0);
+}
+
+
 /* Our own initialisation function */
 void init() {
     // Personal modification
@@ -127,27 +163,30 @@ void init() {
     x = 0;
     y = 0;
     inc = 0.001f;
+    animation.reset({x, y});
 
     /* Create a vertex buffer object to store our array of vertices */
     /* A vertex buffer is a memory object that is created and owned by
-       the OpenGL context */
-
-    /* Generate buffer names (unique index identifiers) */
-    glGenBuffers(1, &positionBufferObject);
-
-    /* Specify the current active buffer object by identifier */
-    glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
-
-    /* Allocates OpenGL memory for storing data or indices, any data
-       previously defined is deleted */
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexPositions), vertexPositions, GL_DYNAMIC_DRAW);
+       the OpenGL context. This one changes every frame, so it is a streaming
+       buffer: one copy of the vertices per frame in flight, written in place
+       instead of reallocated with glBufferData */
+    positionStream = new StreamBuffer(sizeof(vertexPositions));
 
     // Personal modification BELOW - for the second triangle
-    glGenBuffers(1, &secondPositionBufferObject);
-    glBindBuffer(GL_ARRAY_BUFFER, secondPositionBufferObject);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(secondVertexPositions), secondVertexPositions, GL_STATIC_DRAW);
-
-    /* Stop using buffer object for target (GL_ARRAY_BUFFER) because buffer name = 0 */
+    /* Static meshes share the wrapper's buffer heap rather than getting a buffer object each */
+    BufferHeap &heap = glw->getBufferHeap();
+    secondTriangle = heap.upload(secondVertexPositions, sizeof(secondVertexPositions));
+
+    /* Attribute pointers are vertex array state, so they are specified once here instead of every
+       frame. Both point at the start of their buffer, and each draw selects its vertices with the
+       first vertex argument of glDrawArrays */
+    setupHeapVertexArray();
+
+    glGenVertexArrays(1, &streamVAO);
+    glBindVertexArray(streamVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, positionStream->getBuffer());
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, VERTEX_STRIDE, 0);
+    glEnableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     /* Define the vertex shader code as a string */
@@ -155,7 +194,7 @@ void init() {
     const std::string vertexShader(
         "#version 410 core\n"
         "layout(location = 0) in vec4 position;\n"
-        "uniform vec2 offset;\n" // Personal modification: offset, for advanced animation speed control feature
+        "layout(std140) uniform FrameData { vec2 offset; };\n" // Personal modification: offset, for advanced animation speed control feature
         "void main()\n"
         "{\n"
         "   gl_Position = position + vec4(offset, 0.0, 0.0);\n" // Personal modification: for advanced animation speed control feature: + vec4(offset, 0.0, 0.0)
@@ -168,7 +207,7 @@ void init() {
     const std::string fragmentShader(
         "#version 410 core\n"
         "out vec4 outputColor;\n"
-        "uniform vec4 inColor;\n" // Personal modification: Dynamically pass in color attribute
+        "layout(std140) uniform DrawData { vec4 inColor; };\n" // Personal modification: Dynamically pass in color attribute
         "void main()\n"
         "{\n"
         "   outputColor = inColor;\n" // Personal modification: From vec4(0.0f, 1.0f, 0.0f, 1.0f) to inColor
@@ -200,6 +239,13 @@ void init() {
         throw std::runtime_error("Shader could not be linked.");
     }
 
+    /* Uniforms come from blocks in the uniform ring, connect the blocks to their binding points */
+    shader.reflect(program);
+    shader.bindBlock("FrameData", FRAME_DATA_BINDING);
+    shader.bindBlock("DrawData", DRAW_DATA_BINDING);
+    verifyLayout<FrameData>(shader, "FrameData", {"offset"});
+    verifyLayout<DrawData>(shader, "DrawData", {"inColor"});
+
     // Personal modification BELOW
     // Enable transparency blending for overlays
     glEnable(GL_BLEND);
@@ -207,124 +253,144 @@ void init() {
 
     // Personal modification BELOW
     // For advanced animation speed control feature
-    startTime = glfwGetTime();
+    // The wrapper's clock rather than glfwGetTime(), so benchmark runs follow a fixed timeline
+    startTime = glw->getTime();
 }
 
 
 /* Rendering function */
 void display() {
-    vertexPositions[0] = x;
-    vertexPositions[1] = y; // Personal modification here
+    const AnimationState &state = animation.read();
+    vertexPositions[0] = state.x;
+    vertexPositions[1] = state.y; // Personal modification here
 
     /* Update the vertex buffer object with the modified array of vertices */
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexPositions), vertexPositions, GL_DYNAMIC_DRAW);
+    positionStream->beginFrame();
+    GLintptr positionOffset = positionStream->write(vertexPositions, sizeof(vertexPositions));
+
+    /* State changes go through the wrapper's state tracker, which drops the ones that would set
+       what is already set, e.g. the same program every frame */
+    GLState &gl = glw->getState();
+
+    /* A little heap compaction every frame, before anything is drawn from the heap. Only a move
+       to another page needs the vertex array to be set up again, see setupHeapVertexArray(). */
+    std::vector<BufferHeap::Handle> moved;
+    glw->getBufferHeap().compact(COMPACT_BUDGET, &moved);
+    for (BufferHeap::Handle handle : moved) {
+        if (handle != secondTriangle) continue;
+        setupHeapVertexArray();
+        gl.invalidate(); // The bindings were changed behind the state tracker's back
+    }
 
     /* Define the background colour*/
-    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    gl.clearColor(1.0f, 1.0f, 1.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
     /* Set the current shader program to be used */
-    glUseProgram(program);
+    gl.useProgram(program);
 
     // Personal modification for drawing wireframe triangle
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    // Personal modification BELOW
+    // For advanced feature: Animation speed control feature
+    // Obtain time difference, unit: seconds
+    double currentTime = glw->getTime();
+    double delta = currentTime - startTime;
+    // Use time to control the animation (left-right panning)
+    float xOffset = sin(delta) * 0.5f; // Oscillates back and forth within the interval [-0.5, 0.5]
+
+    // Pack this frame's uniforms into the ring and upload them in one go
+    UniformRing &ring = glw->getUniformRing();
+    FrameData frame;
+    frame.set<0>(glm::vec2(xOffset, 0.0f));
+    UniformRing::Range frameRange = ring.push(frame);
+    DrawData blue, green;
+    blue.set<0>(glm::vec4(0.0f, 0.0f, 1.0f, 0.5f)); // Blue, 0.5f transparency
+    green.set<0>(glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
+    UniformRing::Range blueRange = ring.push(blue);
+    UniformRing::Range greenRange = ring.push(green);
+    ring.flush();
+    ring.bind(FRAME_DATA_BINDING, frameRange);
+
     // Personal modification BELOW
     // SET COLOR
-    GLint colorLoc = glGetUniformLocation(program, "inColor");
-    glUniform4f(colorLoc, 0.0f, 0.0f, 1.0f, 0.5f); // Set color to blue, 0.5f transparency
+    ring.bind(DRAW_DATA_BINDING, blueRange);
 
     // === Drawing the SECOND (NEW) triangle ===
 
     // Personal modification BELOW
     // Draw the second triangle in blue
-    glBindBuffer(GL_ARRAY_BUFFER, secondPositionBufferObject);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
+    /* The vertex array points at the start of the heap page, the block is found by its first vertex */
+    gl.bindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, glw->getBufferHeap().firstVertex(secondTriangle, VERTEX_STRIDE), 3);
 
     // === Drawing the ORIGINAL triangle ===
 
-    /* Set the current active buffer object */
-    glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
-
-    /* Specifies where the dat values associated with index can be accessed in the vertex shader */
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
-
-    /* Enable the vertex array associated with the index*/
-    glEnableVertexAttribArray(0);
+    /* The same for this frame's copy of the vertices in the stream buffer */
+    gl.bindVertexArray(streamVAO);
 
     // Set color back to green
-    glUniform4f(colorLoc, 0.0f, 1.0f, 0.0f, 1.0f); // Green
+    ring.bind(DRAW_DATA_BINDING, greenRange); // Green
 
     /* Constructs a sequence of geometric primitives using the elements from the currently
        bound matrix */
     // Personal modification: GL_TRIANGLES for drawing triangles, GL_POINTS for drawing points
-    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glDrawArrays(GL_TRIANGLES, (GLint) (positionOffset / VERTEX_STRIDE), 3);
 
-    // Personal modification BELOW
-    // For advanced feature: Animation speed control feature
-    // Obtain time difference, unit: seconds
-    double currentTime = glfwGetTime();
-    double delta = currentTime - startTime;
-    // Use time to control the animation (left-right panning)
-    float xOffset = sin(delta) * 0.5f; // Oscillates back and forth within the interval [-0.5, 0.5]
-    // Set uniform offset
-    GLint offsetLoc = glGetUniformLocation(program, "offset");
-    glUniform2f(offsetLoc, xOffset, 0.0f);
+    /* The GPU may read this frame's copy of the vertices until the fence passes */
+    positionStream->endFrame();
 
-    /* Disable vertex array and shader program */
-    glDisableVertexAttribArray(0);
-    glUseProgram(0);
+    /* The program and vertex arrays stay bound, the next frame uses them again */
 }
 
-/* Standard main program */
-int main(void) {
-    GLFWwindow *window;
-
-    /* Register the error callback first to enable any GLFW errors to be processed*/
-    glfwSetErrorCallback(error_callback);
-
-    /* Init GLFW */
-    if (!glfwInit())
-        exit(EXIT_FAILURE);
+/* Modify our animation variables, called by the wrapper once per fixed time step */
+void update(double dt) {
+    // Personal modification for feature
+    // The 'C' key is read from the wrapper's input queue so the animation variables have a single owner
+    for (const InputEvent &event : glw->pollInput()) {
+        if (event.type == InputEvent::KEY && event.code == GLFW_KEY_C) {
+            y += (GLfloat) 10 * inc;
+        }
+    }
 
-    // Personal modification: BELOW
+    x += inc;
+    if (x >= 2 || x <= 0) inc = -inc;
 
-    // Set OpenGL version: 4.1
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4); // Major version num
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1); // Minor version num
+    // y += (GLfloat) 1.5 * inc;
+    if (y >= 2 || y <= 0) inc = -inc;
 
-    // Use the "Core Profile"
-    // This indicates enabling only modern OpenGL features, with no compatibility for legacy interfaces
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    /* Publish the new state for the renderer */
+    AnimationState &next = animation.write();
+    next.x = x;
+    next.y = y;
+    animation.publish();
+}
 
-#ifdef __APPLE__
-    // macOS specific requirement: Must set "Forward Compatible"
-    // Otherwise, it will crash due to Core Profile being disabled by default
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+/* Standard main program
+   See demo_options.h for the command line options, e.g. --headless --frames N --stats */
+int main(int argc, char *argv[]) {
+    DemoOptions options = parseDemoOptions(argc, argv);
 
-    /* Create a GLFW window, bail out if it doesn't work */
-    window = glfwCreateWindow(640, 480, "Hello Graphics World", nullptr, nullptr);
-    if (!window) {
-        glfwTerminate();
-        exit(EXIT_FAILURE);
-    }
+    /* Register the error callback first to enable any GLFW errors to be processed*/
+    glfwSetErrorCallback(error_callback);
 
-    /* Associate an OpenGL context with the recently created GLFW window */
-    glfwMakeContextCurrent(window);
+    /* Create a window (and OpenGL 4.1 core context), bail out if it doesn't work */
+    int width = options.width > 0 ? options.width : 640;
+    int height = options.height > 0 ? options.height : 480;
+    glw = new GLWrapper(width, height, "Hello Graphics World", options.headless);
+    applyDemoOptions(glw, options);
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
-        std::cout << "Failed to initialize GLAD. Exiting." << std::endl;
-        return -1;
+    /* Benchmark runs press 'C' once every 60 frames instead of reading the keyboard */
+    if (options.benchmark) {
+        for (int frame = 60; frame < options.warmup + options.frames; frame += 60) {
+            glw->scheduleKeyPress(frame, GLFW_KEY_C);
+        }
     }
 
     /* Register callbacks for keyboard and window resize */
-    glfwSetKeyCallback(window, key_callback);
-    glfwSetFramebufferSizeCallback(window, reshape);
+    glw->setKeyCallback(key_callback);
+    glw->setReshapeCallback(reshape);
 
     // Personal modification for drawing points
     glEnable(GL_PROGRAM_POINT_SIZE);
@@ -332,27 +398,16 @@ int main(void) {
     /* Call our own function to perform any setup work*/
     init();
 
-    /* The event loop */
-    while (!glfwWindowShouldClose(window)) {
-        /* Call our own drawing function */
-        display();
-
-        /* Swap buffers: GLFW is double buffered as standard */
-        glfwSwapBuffers(window);
-
-        /* Processes registered events, causes the callbacks to be called.*/
-        glfwPollEvents();
+    /* Our own drawing and animation functions, called from the event loop */
+    glw->setRenderer(display);
+    glw->setUpdateCallback(update);
 
-        /* Modify our animation variables */
-        x += inc;
-        if (x >= 2 || x <= 0) inc = -inc;
-
-        // y += (GLfloat) 1.5 * inc;
-        if (y >= 2 || y <= 0) inc = -inc;
-    }
+    /* The event loop */
+    glw->eventLoop();
+    reportBenchmark(glw, options);
 
     /* Clean up */
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    delete positionStream;
+    delete (glw);
     exit(EXIT_SUCCESS);
 }
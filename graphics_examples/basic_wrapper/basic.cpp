@@ -16,21 +16,50 @@ if you prefer */
 /* Include the header to the GLFW wrapper class which
    also includes the OpenGL extension initialisation */
 #include "wrapper_glfw.h"
+#include "demo_options.h"
+#include "triple_buffer.h"
+#include "shader_program.h"
+#include "uniform_ring.h"
+#include "std_layout.h"
+#include "buffer_heap.h"
 #include <iostream>
+#include <cmath>
 
-GLuint positionBufferObject;
+BufferHeap::Handle triangle;
 GLuint program;
 GLuint vao;
 
+GLWrapper *glw;
+
 using namespace std;
 
 // Personal modification BELOW
-// Global variables for keyboard control
+// Global variables for keyboard control, only touched by update()
 float offsetX = 0.0f;
 float offsetY = 0.0f;
 float colorR = 0.0f, colorG = 1.0f, colorB = 1.0f; // Initial color
-GLuint offsetLocation;
-GLuint colorLocation;
+
+/* Snapshot of the keyboard controlled state that update() hands to display() */
+struct ViewState {
+    float offsetX, offsetY;
+    float colorR, colorG, colorB;
+};
+TripleBuffer<ViewState> view;
+
+/* The DrawData block in basic.vert and basic.frag, laid out by the std140 rules */
+typedef Std140<glm::vec2, glm::vec3> DrawData;
+enum { OFFSET, COLOR };
+static_assert(DrawData::offset<COLOR>() == 16 && DrawData::SIZE == 32, "std140: a vec3 starts on a 16 byte boundary");
+const GLuint DRAW_DATA_BINDING = 0;
+
+ShaderProgram shader;
+
+/* Block bindings are program state, so they are set again whenever the program is rebuilt, see --hot-reload */
+void bindUniformBlocks(GLuint program) {
+    shader.reflect(program);
+    shader.bindBlock("DrawData", DRAW_DATA_BINDING);
+    verifyLayout<DrawData>(shader, "DrawData", {"offset", "color"});
+}
 
 /*
 This function is called before entering the main rendering loop.
@@ -46,9 +75,12 @@ void init(GLWrapper *glw) {
         -0.75f, -0.75f, 0.0f, 1.0f,
     };
 
-    glGenBuffers(1, &positionBufferObject);
-    glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexPositions), vertexPositions, GL_STATIC_DRAW);
+    triangle = glw->getBufferHeap().upload(vertexPositions, sizeof(vertexPositions));
+
+    // The attribute pointer is vertex array state: set it once, pointing at the start of the heap page
+    glBindBuffer(GL_ARRAY_BUFFER, glw->getBufferHeap().buffer(triangle));
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    glEnableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
     try {
@@ -63,33 +95,35 @@ void init(GLWrapper *glw) {
 
     // Personal modification BELOW
     // For keyboard control
-    glUseProgram(program);
-    offsetLocation = glGetUniformLocation(program, "offset");
-    colorLocation = glGetUniformLocation(program, "color");
-    glUseProgram(0);
+    bindUniformBlocks(program);
+
+    view.reset({offsetX, offsetY, colorR, colorG, colorB});
 }
 
 // Called to update the display.
 // You should call glfwSwapBuffers() after all of your rendering to display what you rendered.
 void display() {
-    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    // Through the state tracker, so settings that are already current are not sent again
+    GLState &gl = glw->getState();
+    gl.clearColor(1.0f, 1.0f, 1.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    glUseProgram(program);
-
-    glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    gl.useProgram(program);
+    gl.bindVertexArray(vao);
 
     // Personal modification BELOW
-    // Update uniform
-    glUniform2f(offsetLocation, offsetX, offsetY);
-    glUniform3f(colorLocation, colorR, colorG, colorB);
-
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-
-    glDisableVertexAttribArray(0);
-    glUseProgram(0);
+    // Update uniform: one block in the uniform ring rather than a glUniform call per value
+    const ViewState &state = view.read();
+    DrawData draw;
+    draw.set<OFFSET>(glm::vec2(state.offsetX, state.offsetY));
+    draw.set<COLOR>(glm::vec3(state.colorR, state.colorG, state.colorB));
+    UniformRing &ring = glw->getUniformRing();
+    UniformRing::Range range = ring.push(draw);
+    ring.flush();
+    ring.bind(DRAW_DATA_BINDING, range);
+
+    // The triangle is a block of the buffer heap, drawn from its first vertex in the shared page
+    glDrawArrays(GL_TRIANGLES, glw->getBufferHeap().firstVertex(triangle, 4 * sizeof(float)), 3);
 }
 
 
@@ -98,35 +132,49 @@ static void reshape(GLFWwindow *window, int w, int h) {
     glViewport(0, 0, (GLsizei) w, (GLsizei) h);
 }
 
-/* change view angle, exit upon ESC */
-static void keyCallback(GLFWwindow *window, int k, int s, int action, int mods) {
-    if (action != GLFW_PRESS) return;
-
-    cout << "KEY: " << (char) k << endl;
-
-    if (k == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-        glfwSetWindowShouldClose(window, GL_TRUE);
+/* Apply the key presses queued since the last step, called by the wrapper at a fixed time step
+   (possibly on its own thread, see --update-thread) */
+void update(double dt) {
+    InputEvents input = glw->pollInput();
+    if (input.empty()) return;
 
     // Personal modification below: Key control
     const float moveStep = 0.05f;
     const float colorStep = 0.1f;
 
-    switch (k) {
-        case GLFW_KEY_W: offsetY += moveStep;
-            break;
-        case GLFW_KEY_S: offsetY -= moveStep;
-            break;
-        case GLFW_KEY_A: offsetX -= moveStep;
-            break;
-        case GLFW_KEY_D: offsetX += moveStep;
-            break;
-        case GLFW_KEY_R: colorR = fmin(colorR + colorStep, 1.0f);
-            break;
-        case GLFW_KEY_G: colorG = fmin(colorG + colorStep, 1.0f);
-            break;
-        case GLFW_KEY_B: colorB = fmin(colorB + colorStep, 1.0f);
-            break;
+    for (const InputEvent &event : input) {
+        if (event.type != InputEvent::KEY || event.action != GLFW_PRESS) continue;
+
+        switch (event.code) {
+            case GLFW_KEY_W: offsetY += moveStep;
+                break;
+            case GLFW_KEY_S: offsetY -= moveStep;
+                break;
+            case GLFW_KEY_A: offsetX -= moveStep;
+                break;
+            case GLFW_KEY_D: offsetX += moveStep;
+                break;
+            case GLFW_KEY_R: colorR = fmin(colorR + colorStep, 1.0f);
+                break;
+            case GLFW_KEY_G: colorG = fmin(colorG + colorStep, 1.0f);
+                break;
+            case GLFW_KEY_B: colorB = fmin(colorB + colorStep, 1.0f);
+                break;
+        }
     }
+
+    ViewState &next = view.write();
+    next = {offsetX, offsetY, colorR, colorG, colorB};
+    view.publish();
+
+    // The scene only changes here, so this is the only place that needs a new frame
+    glw->requestRedraw();
+}
+
+/* Exit upon ESC, everything else is handled by update() */
+static void keyCallback(GLFWwindow *window, int k, int s, int action, int mods) {
+    if (k == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+        glfwSetWindowShouldClose(window, GL_TRUE);
 }
 
 /* An error callback function to output GLFW errors*/
@@ -134,26 +182,42 @@ static void error_callback(int error, const char *description) {
     fputs(description, stderr);
 }
 
-/* Entry point of program */
+/* Entry point of program
+   See demo_options.h for the command line options, e.g. --headless --frames N --stats */
 int main(int argc, char *argv[]) {
-    const char *title = "Hello World LOL";
-    GLWrapper *glw = new GLWrapper(1024, 768, title);
+    DemoOptions options = parseDemoOptions(argc, argv);
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
-        cout << "Failed to initialize GLAD. Exiting." << endl;
-        return -1;
+    const char *title = "Hello World LOL";
+    int width = options.width > 0 ? options.width : 1024;
+    int height = options.height > 0 ? options.height : 768;
+    glw = new GLWrapper(width, height, title, options.headless);
+    applyDemoOptions(glw, options);
+
+    // Benchmark runs replay a fixed sequence of key presses instead of reading the keyboard
+    if (options.benchmark) {
+        const int script[] = {GLFW_KEY_D, GLFW_KEY_W, GLFW_KEY_R, GLFW_KEY_A, GLFW_KEY_S, GLFW_KEY_G, GLFW_KEY_B};
+        const int scriptLength = sizeof(script) / sizeof(script[0]);
+        for (int frame = 10, i = 0; frame < options.warmup + options.frames; frame += 10, i++) {
+            glw->scheduleKeyPress(frame, script[i % scriptLength]);
+        }
     }
 
+    // Only redraw after a key press rather than continuously
+    glw->setRenderOnDemand(true);
+
     glw->setRenderer(display);
+    glw->setUpdateCallback(update);
     glw->setKeyCallback(keyCallback);
     glw->setReshapeCallback(reshape);
     glw->setErrorCallback(error_callback);
 
     init(glw);
 
+    // Edits to the shader files show up without restarting
+    if (options.hotReload) glw->watchShader("basic.vert", "basic.frag", &program, bindUniformBlocks);
+
     glw->eventLoop();
+    reportBenchmark(glw, options);
 
     delete (glw);
     return 0;
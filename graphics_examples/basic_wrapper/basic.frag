@@ -6,7 +6,11 @@
 out vec4 outputColor;
 
 // Personal modification for keyboard control
-uniform vec3 color; // New: color control
+// Per-draw values from the demo's uniform ring, the same block as in basic.vert
+layout(std140) uniform DrawData {
+    vec2 offset;
+    vec3 color;
+};
 
 void main()
 {
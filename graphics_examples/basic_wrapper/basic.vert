@@ -6,7 +6,11 @@
 layout(location = 0) in vec4 position;
 
 // Personal modification for keyboard control
-uniform vec2 offset;
+// Per-draw values from the demo's uniform ring, the same block as in basic.frag
+layout(std140) uniform DrawData {
+    vec2 offset;
+    vec3 color;
+};
 
 void main()
 {
@@ -0,0 +1,170 @@
+/*
+ Upload benchmark for the DynamicBuffer strategies: for every strategy, payload size
+ (64 B to 64 MB by powers of 4) and number of updates per frame, replaces the buffer
+ contents and draws a point from it after each update, so the GPU really consumes
+ every version. Prints one line of JSON per run with the throughput and the CPU time
+ per update, then one line per size naming the fastest strategy on this driver.
+
+ Usage: buffer_bench [--strategy NAME] [--min-size BYTES] [--max-size BYTES] [--budget MB]
+*/
+
+#include "wrapper_glfw.h"
+#include "dynamic_buffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const int UPDATES_PER_FRAME[] = {1, 8, 64};
+
+// Every run makes at least MIN_UPDATES updates, and at most MAX_UPDATES for tiny payloads
+static const size_t MIN_UPDATES = 16;
+static const size_t MAX_UPDATES = 8192;
+
+struct Result {
+    double megabytesPerSecond;
+    double cpuMicroseconds;   // Process CPU time per update, includes driver threads
+    double wallMicroseconds;  // Per update, up to the GPU finishing the last draw
+};
+
+static const char *VERTEX_SHADER =
+        "#version 410 core\n"
+        "layout(location = 0) in vec4 position;\n"
+        "void main() { gl_Position = vec4(position.xyz * 0.0, 1.0); gl_PointSize = 1.0; }\n";
+
+static const char *FRAGMENT_SHADER =
+        "#version 410 core\n"
+        "out vec4 outputColor;\n"
+        "void main() { outputColor = vec4(1.0); }\n";
+
+static Result run(DynamicBuffer::Strategy strategy, GLsizeiptr size, int perFrame, size_t budget,
+                  vector<char> &payload) {
+    size_t updates = min(MAX_UPDATES, max(MIN_UPDATES, budget / size));
+    size_t frames = max<size_t>(1, updates / perFrame);
+    updates = frames * perFrame;
+
+    DynamicBuffer buffer(GL_ARRAY_BUFFER, size, strategy, perFrame);
+
+    // One frame unmeasured, for the first allocation and any lazy driver setup
+    for (int i = 0; i < perFrame; i++) {
+        GLintptr offset = buffer.update(payload.data(), size);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void *) offset);
+        glDrawArrays(GL_POINTS, 0, 1);
+    }
+    buffer.endFrame();
+    glFinish();
+
+    clock_t cpuStart = clock();
+    Clock::time_point start = Clock::now();
+    for (size_t frame = 0; frame < frames; frame++) {
+        for (int i = 0; i < perFrame; i++) {
+            // Different bytes every time, so nothing can skip an unchanged upload
+            payload[0]++;
+            GLintptr offset = buffer.update(payload.data(), size);
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void *) offset);
+            glDrawArrays(GL_POINTS, 0, 1);
+        }
+        // Stands in for the swap at the end of a frame
+        buffer.endFrame();
+        glFlush();
+    }
+    glFinish();
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+    double cpuSeconds = double(clock() - cpuStart) / CLOCKS_PER_SEC;
+
+    Result result;
+    result.megabytesPerSecond = seconds > 0 ? double(size) * updates / seconds / (1024 * 1024) : 0;
+    result.cpuMicroseconds = cpuSeconds * 1e6 / updates;
+    result.wallMicroseconds = seconds * 1e6 / updates;
+    return result;
+}
+
+int main(int argc, char *argv[]) {
+    vector<DynamicBuffer::Strategy> strategies;
+    GLsizeiptr minSize = 64;
+    GLsizeiptr maxSize = 64 << 20;
+    size_t budget = 256 << 20;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--strategy") == 0 && hasValue) {
+            DynamicBuffer::Strategy strategy;
+            if (!DynamicBuffer::parseStrategy(argv[++i], strategy)) {
+                cerr << "Unknown strategy " << argv[i] << endl;
+                return 1;
+            }
+            strategies.push_back(strategy);
+        } else if (strcmp(argv[i], "--min-size") == 0 && hasValue) {
+            minSize = max(1L, atol(argv[++i]));
+        } else if (strcmp(argv[i], "--max-size") == 0 && hasValue) {
+            maxSize = max(1L, atol(argv[++i]));
+        } else if (strcmp(argv[i], "--budget") == 0 && hasValue) {
+            budget = size_t(max(1L, atol(argv[++i]))) << 20;
+        } else {
+            cerr << "Usage: buffer_bench [--strategy NAME] [--min-size BYTES] [--max-size BYTES] [--budget MB]"
+                 << endl;
+            return 1;
+        }
+    }
+    if (strategies.empty()) {
+        for (int i = 0; i < DynamicBuffer::STRATEGY_COUNT; i++) {
+            strategies.push_back((DynamicBuffer::Strategy) i);
+        }
+    }
+
+    GLWrapper *glw = new GLWrapper(64, 64, "buffer_bench", true);
+
+    GLuint program = glw->BuildShaderProgram(VERTEX_SHADER, FRAGMENT_SHADER);
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glUseProgram(program);
+    glEnableVertexAttribArray(0);
+
+    vector<char> payload(maxSize, 1);
+
+    for (GLsizeiptr size = minSize; size <= maxSize; size *= 4) {
+        const char *best = nullptr;
+        double bestRate = 0;
+
+        for (DynamicBuffer::Strategy strategy : strategies) {
+            if (!DynamicBuffer::isSupported(strategy)) continue;
+            for (int perFrame : UPDATES_PER_FRAME) {
+                Result result = run(strategy, size, perFrame, budget, payload);
+                cout << "{\"benchmark\": \"buffer\", \"strategy\": \"" << DynamicBuffer::strategyName(strategy)
+                        << "\", \"size\": " << size << ", \"updates_per_frame\": " << perFrame
+                        << ", \"mb_per_s\": " << result.megabytesPerSecond
+                        << ", \"cpu_us_per_update\": " << result.cpuMicroseconds
+                        << ", \"wall_us_per_update\": " << result.wallMicroseconds << "}" << endl;
+                // Judge strategies on the most common case, one update per frame
+                if (perFrame == 1 && result.megabytesPerSecond > bestRate) {
+                    bestRate = result.megabytesPerSecond;
+                    best = DynamicBuffer::strategyName(strategy);
+                }
+            }
+        }
+        if (best) {
+            cout << "{\"benchmark\": \"buffer_best\", \"size\": " << size << ", \"strategy\": \"" << best
+                    << "\", \"mb_per_s\": " << bestRate << "}" << endl;
+        }
+    }
+
+    glDisableVertexAttribArray(0);
+    glBindVertexArray(0);
+    glDeleteVertexArrays(1, &vao);
+    glUseProgram(0);
+    glDeleteProgram(program);
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR) cerr << "GL error 0x" << hex << error << dec << endl;
+
+    delete glw;
+    return 0;
+}
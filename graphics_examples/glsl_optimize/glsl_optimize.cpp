@@ -0,0 +1,97 @@
+/*
+ Offline shader optimiser: preprocesses shader files (includes and defines), runs
+ them through ShaderOptimizer and writes the result, so optimised sources can be
+ shipped (or embedded, see add_embedded_shaders()) instead of optimised at startup.
+ A .vert given together with a .frag is also pruned against it. No GL context needed.
+
+ Usage: glsl_optimize [-D NAME[=VALUE]]... [-I DIR]... [-o DIR] shader...
+ Without -o the output goes to stdout. A summary is printed to stderr.
+*/
+
+#include "shader_preprocessor.h"
+#include "shader_optimizer.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+static bool hasExtension(const string &path, const char *extension) {
+    return filesystem::path(path).extension() == extension;
+}
+
+int main(int argc, char *argv[]) {
+    ShaderPreprocessor preprocessor;
+    ShaderDefines defines;
+    const char *outputDir = nullptr;
+    vector<string> inputs;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-D") == 0 && hasValue) {
+            string define = argv[++i];
+            size_t equals = define.find('=');
+            if (equals == string::npos) {
+                defines.push_back({define, "1"});
+            } else {
+                defines.push_back({define.substr(0, equals), define.substr(equals + 1)});
+            }
+        } else if (strcmp(argv[i], "-I") == 0 && hasValue) {
+            preprocessor.addIncludePath(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && hasValue) {
+            outputDir = argv[++i];
+        } else {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (inputs.empty()) {
+        cerr << "Usage: glsl_optimize [-D NAME[=VALUE]]... [-I DIR]... [-o DIR] shader..." << endl;
+        return 1;
+    }
+
+    vector<string> sources;
+    try {
+        for (const string &input : inputs) {
+            sources.push_back(preprocessor.processFile(input, defines));
+        }
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    // With exactly one .vert and one .frag, drop vertex outputs the fragment shader never reads
+    ShaderOptimizer::Stats stats;
+    int vert = -1, frag = -1, vertCount = 0, fragCount = 0;
+    for (size_t i = 0; i < inputs.size(); i++) {
+        if (hasExtension(inputs[i], ".vert")) vert = (int) i, vertCount++;
+        if (hasExtension(inputs[i], ".frag")) frag = (int) i, fragCount++;
+    }
+    if (vertCount == 1 && fragCount == 1) {
+        sources[vert] = ShaderOptimizer::pruneVaryings(sources[vert], sources[frag], &stats);
+    }
+
+    for (size_t i = 0; i < inputs.size(); i++) {
+        string optimized = ShaderOptimizer::optimize(sources[i], &stats);
+        if (!outputDir) {
+            cout << optimized;
+            continue;
+        }
+
+        filesystem::create_directories(outputDir);
+        filesystem::path output = filesystem::path(outputDir) / filesystem::path(inputs[i]).filename();
+        ofstream file(output, ios::out | ios::binary);
+        file << optimized;
+        if (!file) {
+            cerr << "Could not write " << output.string() << endl;
+            return 1;
+        }
+    }
+
+    cerr << inputs.size() << " shader(s): " << stats.bytesIn << " -> " << stats.bytesOut << " bytes, "
+         << stats.functionsRemoved << " function(s) and " << stats.declarationsRemoved << " declaration(s) removed, "
+         << stats.definesFolded << " define(s) folded, " << stats.varyingsDemoted << " varying(s) demoted" << endl;
+    return 0;
+}
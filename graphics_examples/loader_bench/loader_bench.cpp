@@ -0,0 +1,65 @@
+/*
+ Startup benchmark for the GL loader: resolves every entry point glad knows
+ (gladLoadGLLoader) and only this target's manifest (gladLoadGLManifest)
+ on the same headless context, and prints the timings as one line of JSON.
+
+ Usage: loader_bench [repeats], default 200
+*/
+
+#include "wrapper_glfw.h"
+#include "glad_manifest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+/* Time one call of a loader in microseconds */
+template<typename F>
+static double timeLoad(F load) {
+    Clock::time_point start = Clock::now();
+    load();
+    return chrono::duration<double, micro>(Clock::now() - start).count();
+}
+
+static double median(vector<double> values) {
+    sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char *argv[]) {
+    int repeats = argc > 1 ? max(1, atoi(argv[1])) : 200;
+
+    // The wrapper's own startup already resolved the manifest once, so even the
+    // first timed call runs with the driver's lookup tables warm
+    GLWrapper *glw = new GLWrapper(64, 64, "loader_bench", true);
+    GLADloadproc proc = glw->getProcAddressLoader();
+
+    vector<double> full, manifest;
+    int manifestResolved = 0;
+
+    // Alternate the two so neither benefits from running second
+    for (int i = 0; i < repeats; i++) {
+        full.push_back(timeLoad([&]() { gladLoadGLLoader(proc); }));
+        manifest.push_back(timeLoad([&]() {
+            manifestResolved = gladLoadGLManifest(proc, gladManifestNames, gladManifestCount);
+        }));
+    }
+
+    double fullMedian = median(full);
+    double manifestMedian = median(manifest);
+    cout << "{\"benchmark\": \"loader\", \"repeats\": " << repeats
+            << ", \"manifest_names\": " << gladManifestCount
+            << ", \"manifest_resolved\": " << manifestResolved
+            << ", \"full_first_us\": " << full[0] << ", \"full_median_us\": " << fullMedian
+            << ", \"manifest_first_us\": " << manifest[0] << ", \"manifest_median_us\": " << manifestMedian
+            << ", \"speedup\": " << (manifestMedian > 0 ? fullMedian / manifestMedian : 0) << "}" << endl;
+
+    delete glw;
+    return 0;
+}
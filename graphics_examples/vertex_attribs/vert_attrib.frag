@@ -4,7 +4,7 @@
 
 #version 410 core
 
-in vec4 fcolour;
+layout(location = 0) in vec4 fcolour;
 out vec4 outputColor;
 void main()
 {
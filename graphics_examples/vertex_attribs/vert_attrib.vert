@@ -5,7 +5,13 @@
 #version 410 core
 layout(location = 0) in vec4 position;
 layout(location = 1) in vec4 colour;
-out vec4 fcolour;
+
+// Declared in full so the shader also works as a separable program (--separable):
+// stages then match their interfaces by location instead of being linked together
+out gl_PerVertex {
+	vec4 gl_Position;
+};
+layout(location = 0) out vec4 fcolour;
 
 void main()
 {
@@ -18,14 +18,44 @@ if you prefer */
 /* Include the header to the GLFW wrapper class which
    includes the GLFW windowing functionality and shader handling */
 #include "wrapper_glfw.h"
+#include "demo_options.h"
+#include "shader_pipelines.h"
+#include "buffer_heap.h"
+#include "vertex_layout.h"
 #include <iostream>
+#include <vector>
 
-GLuint positionBufferObject, colourObject;
+/* Half float positions and normalised byte colours, interleaved in one block:
+   12 bytes per vertex rather than two float4 arrays of 16 bytes each */
+typedef VertexLayout<AttribHalf<4>, AttribUNorm8<4>> Layout;
+enum { POSITION, COLOUR };
+static_assert(Layout::offset<COLOUR>() == 8 && Layout::STRIDE == 12, "Colours follow the 8 byte positions");
+
+BufferHeap::Handle triangle;
+BufferHeap *heap;
 GLuint program;
 GLuint vao;
 
+/* --separable: one program per stage, combined by each view's program pipeline */
+bool separable = false;
+GLuint vertexStage, fragmentStage;
+
 using namespace std;
 
+/* Attribute pointers and enables are vertex array state, so each vertex array is set up once
+   (with its context current) and display() only binds it.
+   One glVertexAttribPointer(index, size, type, normalised, stride, pointer) per attribute,
+   index relates to the layout qualifier in the vertex shader. Both attributes share the
+   12 byte stride; the pointers are the block's offset in the heap page plus the attribute's
+   offset in the vertex. The shader still sees vec4s: half floats are widened and bytes
+   are normalised to 0..1 */
+void setupVertexArray(GLuint vertexArray) {
+    glBindVertexArray(vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, heap->buffer(triangle));
+    Layout::interleaved(heap->offset(triangle));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 /*
 This function is called before entering the main rendering loop.
 Use it for all your initialisation stuff
@@ -52,19 +82,28 @@ void init(GLWrapper *glw) {
         0.0f, 0.0f, 1.0f, 1.0f,
     };
 
-    /* Generate a name for a vertex buffer object */
-    glGenBuffers(1, &positionBufferObject);
-    glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexPositions), vertexPositions, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    /* Pack each vertex's position and colour next to each other */
+    Layout::Vertex vertices[3];
+    for (int i = 0; i < 3; i++) {
+        const float *p = &vertexPositions[4 * i];
+        const float *c = &vertexColours[4 * i];
+        vertices[i].set<POSITION>(glm::vec4(p[0], p[1], p[2], p[3]));
+        vertices[i].set<COLOUR>(glm::vec4(c[0], c[1], c[2], c[3]));
+    }
 
-    glGenBuffers(1, &colourObject);
-    glBindBuffer(GL_ARRAY_BUFFER, colourObject);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertexColours), vertexColours, GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    /* Allocate the vertices from the wrapper's buffer heap instead of a buffer object,
+       the heap's pages are shared with the other views' contexts */
+    heap = &glw->getBufferHeap();
+    triangle = heap->upload(vertices, sizeof(vertices));
+    setupVertexArray(vao);
 
     try {
-        program = glw->LoadShader("vert_attrib.vert", "vert_attrib.frag");
+        if (separable) {
+            vertexStage = glw->getShaderPipelines().loadStage(GL_VERTEX_SHADER, "vert_attrib.vert");
+            fragmentStage = glw->getShaderPipelines().loadStage(GL_FRAGMENT_SHADER, "vert_attrib.frag");
+        } else {
+            program = glw->LoadShader("vert_attrib.vert", "vert_attrib.frag");
+        }
     } catch (exception &e) {
         cout << "Caught exception: " << e.what() << endl;
         cin.ignore();
@@ -74,32 +113,25 @@ void init(GLWrapper *glw) {
 
 // Called to update the display.
 // You should call glfwSwapBuffers() after all of your rendering to display what you rendered.
-void display() {
-    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    glUseProgram(program);
-
-    glBindBuffer(GL_ARRAY_BUFFER, positionBufferObject);
-    glEnableVertexAttribArray(0);
-
-    /* glVertexAttribPointer(index, size, type, normalised, stride, pointer)
-       index relates to the layout qualifier in the vertex shader and in
-       glEnableVertexAttribArray() and glDisableVertexAttribArray() */
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+// The view's user data holds the vertex array object of its context, see main()
+void display(GLWrapper *view) {
+    // Each context has its own state tracker, calls that change nothing are dropped
+    GLState &gl = view->getState();
+    gl.bindVertexArray(*(GLuint *) view->getUserData());
 
-    glBindBuffer(GL_ARRAY_BUFFER, colourObject);
-    glEnableVertexAttribArray(1);
+    gl.clearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
 
-    /* glVertexAttribPointer(index, size, type, normalised, stride, pointer)
-    index relates to the layout qualifier in the vertex shader and in
-    glEnableVertexAttribArray() and glDisableVertexAttribArray() */
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    // Pipeline objects are per context, each view gets its own for the shared stage programs.
+    // A program bound with glUseProgram would take precedence over the pipeline, so none is bound
+    if (separable) {
+        gl.useProgram(0);
+        gl.bindProgramPipeline(view->getShaderPipelines().pipeline(vertexStage, fragmentStage));
+    } else {
+        gl.useProgram(program);
+    }
 
     glDrawArrays(GL_TRIANGLES, 0, 3);
-
-    glDisableVertexAttribArray(0);
-    glUseProgram(0);
 }
 
 
@@ -123,26 +155,66 @@ static void error_callback(int error, const char *description) {
     fputs(description, stderr);
 }
 
-/* Entry point of program */
+/* Entry point of program
+   See demo_options.h for the command line options, e.g. --headless --frames N --stats */
 int main(int argc, char *argv[]) {
-    GLWrapper *glw = new GLWrapper(1024, 768, "Hello Graphics World");;
+    DemoOptions options = parseDemoOptions(argc, argv);
+    separable = options.separable;
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
-        cout << "Failed to initialize GLAD. Exiting." << endl;
-        return -1;
-    }
+    int width = options.width > 0 ? options.width : 1024;
+    int height = options.height > 0 ? options.height : 768;
+    GLWrapper *glw = new GLWrapper(width, height, "Hello Graphics World", options.headless);
+    applyDemoOptions(glw, options);
+
+    // The triangle never changes, so only draw when the window needs repainting
+    // (benchmark runs draw every frame regardless, the scene has no input to script)
+    glw->setRenderOnDemand(true);
 
     glw->setRenderer(display);
     glw->setKeyCallback(keyCallback);
     glw->setReshapeCallback(reshape);
     glw->setErrorCallback(error_callback);
 
+    // Extra windows (--views N) share the buffers and program with the first one,
+    // but vertex array objects are not shared so every context needs its own
+    vector<GLWrapper *> views(1, glw);
+    vector<GLuint> viewVAOs(options.views);
+    for (int i = 1; i < options.views; i++) {
+        GLWrapper *view = new GLWrapper(width / 2, height / 2, "Hello Graphics World", options.headless, glw);
+        view->setRenderOnDemand(true);
+        view->setRenderer(display);
+        view->setKeyCallback(keyCallback);
+        view->setReshapeCallback(reshape);
+        glGenVertexArrays(1, &viewVAOs[i]);
+        views.push_back(view);
+    }
+
+    glw->makeCurrent();
     init(glw);
+    viewVAOs[0] = vao;
+
+    // Edits to the shader files show up without restarting, in every view
+    if (options.hotReload && separable) {
+        cerr << "--hot-reload rebuilds linked programs, it is ignored with --separable" << endl;
+    } else if (options.hotReload) {
+        glw->watchShader("vert_attrib.vert", "vert_attrib.frag", &program);
+    }
 
-    glw->eventLoop();
+    for (size_t i = 0; i < views.size(); i++) {
+        views[i]->setUserData(&viewVAOs[i]);
+        if (i > 0) {
+            views[i]->makeCurrent();
+            setupVertexArray(viewVAOs[i]);
+        }
+    }
+    glw->makeCurrent();
+
+    GLWrapper::eventLoop(views);
+    reportBenchmark(glw, options);
 
+    for (size_t i = views.size() - 1; i > 0; i--) {
+        delete(views[i]);
+    }
     delete(glw);
     return 0;
 }